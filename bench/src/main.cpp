@@ -0,0 +1,653 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file LICENSE.txt in the repository root directory.
+*********************************************************************/
+
+// Headless resource manager stress benchmark. Writes a synthetic resource DB (assets with random sizes, fan-in and
+// depth of prerequisites) using dummy object types, then measures init time, lookup latency, load throughput and
+// unload cost. Needs no window or GPU.
+
+#include "hart/config.h"
+#include "hart/base/std.h"
+#include "hart/base/crt.h"
+#include "hart/base/atomic.h"
+#include "hart/base/filesystem.h"
+#include "hart/base/time.h"
+#include "hart/base/uuid.h"
+#include "hart/core/configoptions.h"
+#include "hart/core/engine.h"
+#include "hart/core/objectfactory.h"
+#include "hart/core/resourcemanager.h"
+#include "hart/core/taskgraph.h"
+#include "hart/fbs/resourcedb_generated.h"
+#include "getopt.h"
+#include "minfs.h"
+#include <algorithm>
+
+#if HART_DEBUG_INFO
+// There is no engine to show the resource manager's debug menus
+namespace hart {
+namespace engine {
+DebugMenuHandle addDebugMenu(char const*, DebugMenuCallback) {
+  return 0;
+}
+void removeDebugMenu(DebugMenuHandle) {}
+}
+}
+#endif
+
+struct Options {
+  uint32_t    assets = 10000;
+  uint32_t    types = 4;
+  uint32_t    fanin = 2; // prerequisites per asset
+  uint32_t    depth = 4; // levels of prerequisites below the top level assets
+  uint32_t    minSize = 64;
+  uint32_t    maxSize = 4096;
+  uint32_t    roots = 1000; // loads per pass, taken from the top level
+  uint32_t    passes = 2;
+  uint32_t    lookups = 1000000;
+  uint32_t    cacheKB = 0;
+  uint32_t    reloads = 0; // payloads to rewrite while loaded, needs a debug build
+  uint32_t    dupes = 0;   // percentage of assets that duplicate another asset's payload
+  float       unloadMS = 1.f;
+  float       loadMS = 2.f;
+  int32_t     workers = 4;
+  uint64_t    seed = 1;
+  bool        unsorted = false; // mark the DB unsorted so the resource manager builds its fallback index
+  bool        noClosure = false; // don't write flattened dependency lists, loads walk the prerequisites instead
+  bool        reuse = false;    // don't rewrite the DB and payloads if they exist
+  bool        shared = false;   // publish and map payloads through the cross process shared cache
+  const char* dir = "resmgrbench_data";
+  const char* metrics = nullptr;
+};
+
+// xorshift64*
+struct Random {
+  uint64_t state;
+  explicit Random(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ull;
+  }
+  uint32_t range(uint32_t n) { return n ? (uint32_t)(next() % n) : 0; }
+};
+
+struct SyntheticDB {
+  hstd::vector<hresmgr::resid_t>       ids; // by slot
+  hstd::vector<uint32_t>               sizes;
+  hstd::vector<uint32_t>               types;
+  hstd::vector<hstd::vector<uint32_t>> prerequisites;
+  hstd::vector<hstd::vector<uint32_t>> levels;  // slots at each depth, 0 has no prerequisites
+  hstd::vector<int32_t>                aliasOf; // slot with the same payload, loaded in place of this one, or -1
+  uint32_t                             aliases = 0;
+
+  uint32_t canonical(uint32_t slot) const { return aliasOf[slot] < 0 ? slot : (uint32_t)aliasOf[slot]; }
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Dummy object types. Payloads are a flatbuffer style header (root offset, typecc) then the payload size and noise.
+//////////////////////////////////////////////////////////////////////////
+
+struct PayloadHeader {
+  uint32_t rootOffset;
+  uint32_t typecc;
+  uint32_t size;
+};
+
+struct DummyObject {
+  uint64_t checksum;
+  uint32_t size;
+};
+
+static hatomic::aint32_t liveObjects;
+static hatomic::aint32_t constructedObjects;
+
+static void* dummyMalloc() {
+  return new DummyObject();
+}
+static void dummyFree(void* ptr) {
+  delete (DummyObject*)ptr;
+  hatomic::decrement(liveObjects);
+}
+static void dummyConstruct(void*) {
+  hatomic::increment(liveObjects);
+  hatomic::increment(constructedObjects);
+}
+static void dummyDestruct(void*) {}
+static bool dummyDeserialise(void const* src, void* dst, hobjfact::SerialiseParams const& params) {
+  // Touch every byte, standing in for real deserialise work
+  auto const*    hdr = (PayloadHeader const*)src;
+  uint8_t const* bytes = (uint8_t const*)src;
+  uint64_t       hash = HART_FVN_OFFSET_BASIS;
+  for (uint32_t i = sizeof(PayloadHeader); i < hdr->size; ++i) {
+    hash = (hash ^ bytes[i]) * HART_FVN_PRIME;
+  }
+  // Fold in the prerequisites, the way a real type would point into them
+  for (uint32_t i = 0, n = params.resdata->prerequisiteCount; i < n; ++i) {
+    hdbassert(params.resdata->prerequisites[i].data, "Prerequisite isn't loaded");
+    hash ^= ((DummyObject const*)params.resdata->prerequisites[i].data)->checksum;
+  }
+  DummyObject* obj = (DummyObject*)dst;
+  obj->checksum = hash;
+  obj->size = hdr->size;
+  return true;
+}
+
+static uint32_t dummyTypeCC(uint32_t type) {
+  return HART_MAKE_FOURCC('b', 'n', '0' + (type / 10) % 10, '0' + type % 10);
+}
+
+static void registerDummyTypes(uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i) {
+    hobjfact::ObjectDefinition def(dummyTypeCC(i), "DummyObject", sizeof(DummyObject), dummyMalloc, dummyFree,
+                                   dummyConstruct, dummyDestruct, dummyDeserialise, nullptr, nullptr,
+                                   hobjfact::ObjectFlag_ThreadSafeFree);
+    hobjfact::objectFactoryRegister(def, nullptr);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Generation
+//////////////////////////////////////////////////////////////////////////
+
+// Same order as the resource manager's binary search
+static bool uuidLess(hresmgr::resid_t const& lhs, hresmgr::resid_t const& rhs) {
+  for (int32_t i = 3; i >= 0; --i) {
+    if (lhs.words[i] != rhs.words[i]) return lhs.words[i] < rhs.words[i];
+  }
+  return false;
+}
+
+// Deterministic for a given seed, so --reuse can rebuild it without touching the disk
+static void generateGraph(Options const& opts, SyntheticDB* db) {
+  Random rnd(opts.seed);
+
+  db->ids.reserve(opts.assets);
+  while (db->ids.size() < opts.assets) {
+    while (db->ids.size() < opts.assets) {
+      hresmgr::resid_t id;
+      id.dwords[0] = rnd.next();
+      id.dwords[1] = rnd.next();
+      db->ids.push_back(id);
+    }
+    std::sort(db->ids.begin(), db->ids.end(), uuidLess);
+    db->ids.erase(std::unique(db->ids.begin(), db->ids.end()), db->ids.end());
+  }
+
+  db->sizes.resize(opts.assets);
+  db->types.resize(opts.assets);
+  db->prerequisites.resize(opts.assets);
+  db->levels.resize(opts.depth + 1);
+  hstd::vector<uint32_t> level_of(opts.assets);
+  for (uint32_t i = 0; i < opts.assets; ++i) {
+    level_of[i] = rnd.range(opts.depth + 1);
+    db->levels[level_of[i]].push_back(i);
+    db->sizes[i] = opts.minSize + rnd.range(opts.maxSize - opts.minSize + 1);
+    db->types[i] = i % opts.types;
+  }
+
+  // A duplicate copies an earlier asset on its own level, the way the builder's content hash would find it
+  db->aliasOf.assign(opts.assets, -1);
+  if (opts.dupes) {
+    for (uint32_t i = 0; i < opts.assets; ++i) {
+      if (rnd.range(100) >= opts.dupes) continue;
+      auto const& level = db->levels[level_of[i]];
+      uint32_t    of = level[rnd.range((uint32_t)level.size())];
+      if (of >= i || db->aliasOf[of] >= 0) continue;
+      db->aliasOf[i] = (int32_t)of;
+      db->sizes[i] = db->sizes[of];
+      db->types[i] = db->types[of];
+      ++db->aliases;
+    }
+  }
+
+  // The first prerequisite comes from the level directly below, so chains reach the full depth. The rest can come from
+  // any lower level.
+  for (uint32_t i = 0; i < opts.assets; ++i) {
+    uint32_t level = level_of[i];
+    if (level == 0) continue;
+    auto& prereqs = db->prerequisites[i];
+    if (db->aliasOf[i] >= 0) {
+      prereqs = db->prerequisites[db->aliasOf[i]];
+      continue;
+    }
+    // Prerequisites always name the canonical asset, as the builder remaps them
+    for (uint32_t f = 0; f < opts.fanin; ++f) {
+      auto const& from = db->levels[f == 0 ? level - 1 : rnd.range(level)];
+      if (from.empty()) continue;
+      prereqs.push_back(db->canonical(from[rnd.range((uint32_t)from.size())]));
+    }
+    std::sort(prereqs.begin(), prereqs.end());
+    prereqs.erase(std::unique(prereqs.begin(), prereqs.end()), prereqs.end());
+  }
+}
+
+static bool writeFile(const char* path, void const* data, size_t size) {
+  hfs::FileHandle   file;
+  hfs::FileOpHandle op = hfs::openFile(path, hfs::Mode::Write, &file);
+  if (hfs::fileOpWait(op) != hfs::Error::Ok) return false;
+  op = hfs::fwriteAsync(file, data, size, 0);
+  bool ok = hfs::fileOpWait(op) == hfs::Error::Ok;
+  hfs::closeFile(file);
+  return ok;
+}
+
+static void payloadPath(uint32_t slot, char* out, size_t size) {
+  // 4096 files per directory
+  hcrt::sprintf(out, size, "/data/synthetic/%03x/%08x.bin", slot >> 12, slot);
+}
+
+static bool writePayload(SyntheticDB const& db, uint32_t slot, Random* rnd, hstd::vector<uint8_t>* payload) {
+  char path[HART_MAX_PATH];
+  payload->resize(hutil::tmax<uint32_t>(db.sizes[slot], sizeof(PayloadHeader)));
+  for (size_t b = sizeof(PayloadHeader); b < payload->size(); ++b) {
+    (*payload)[b] = (uint8_t)rnd->next();
+  }
+  PayloadHeader hdr = {sizeof(flatbuffers::uoffset_t) * 2, dummyTypeCC(db.types[slot]), (uint32_t)payload->size()};
+  hcrt::memcpy(payload->data(), &hdr, sizeof(hdr));
+  payloadPath(slot, path, sizeof(path));
+  if (!writeFile(path, payload->data(), payload->size())) {
+    printf("Failed to write %s\n", path);
+    return false;
+  }
+  return true;
+}
+
+// Same order as the builder's gather_load_order()
+static void gatherLoadOrder(SyntheticDB const& db, uint32_t slot, hstd::vector<uint8_t>* seen,
+                            hstd::vector<uint32_t>* out) {
+  if ((*seen)[slot]) return;
+  (*seen)[slot] = 1;
+  for (auto p : db.prerequisites[slot])
+    gatherLoadOrder(db, p, seen, out);
+  out->push_back(slot);
+}
+
+static bool writeDB(Options const& opts, char const* native_root, SyntheticDB const& db) {
+  Random                rnd(opts.seed ^ 0xDA7A);
+  hstd::vector<uint8_t> payload;
+  char                  path[HART_MAX_PATH];
+  hstd::vector<uint64_t> hashes(opts.assets);
+  for (uint32_t i = 0; i < opts.assets; ++i) {
+    if ((i & 4095) == 0) {
+      hcrt::sprintf(path, sizeof(path), "%sdata/synthetic/%03x", native_root, i >> 12);
+      minfs_create_directories(path);
+    }
+    if (db.aliasOf[i] >= 0) {
+      hashes[i] = hashes[db.aliasOf[i]];
+      continue;
+    }
+    if (!writePayload(db, i, &rnd, &payload)) return false;
+    hashes[i] = HART_FVN_OFFSET_BASIS;
+    for (auto b : payload)
+      hashes[i] = (hashes[i] ^ b) * HART_FVN_PRIME;
+  }
+
+  flatbuffers::FlatBufferBuilder                            fbb;
+  hstd::vector<hart::resource::uuid>                        uuids;
+  hstd::vector<flatbuffers::Offset<hart::fb::ResourceInfo>> infos;
+  hstd::vector<uint8_t>                                     seen(opts.assets);
+  hstd::vector<uint32_t>                                    load_order;
+  uuids.reserve(opts.assets);
+  infos.reserve(opts.assets);
+  for (uint32_t i = 0; i < opts.assets; ++i) {
+    auto const& id = db.ids[i];
+    uuids.push_back(hart::resource::uuid(id.words[3], id.words[2], id.words[1], id.words[0]));
+    char name[64];
+    hcrt::sprintf(name, sizeof(name), "synthetic_%08x", i);
+    // Aliases share the canonical asset's file rather than writing their own
+    payloadPath(db.canonical(i), path, sizeof(path));
+    auto friendly_name = fbb.CreateString(name);
+    auto filepath = fbb.CreateString(path);
+    auto prereqs = fbb.CreateVector(db.prerequisites[i]);
+    flatbuffers::Offset<flatbuffers::Vector<uint32_t>> dep_closure;
+    if (!opts.noClosure && db.aliasOf[i] < 0 && !db.prerequisites[i].empty()) {
+      load_order.clear();
+      gatherLoadOrder(db, i, &seen, &load_order);
+      for (auto s : load_order)
+        seen[s] = 0;
+      dep_closure = fbb.CreateVector(load_order);
+    }
+    uint32_t size = hutil::tmax<uint32_t>(db.sizes[i], sizeof(PayloadHeader));
+    infos.push_back(hart::fb::CreateResourceInfo(fbb, friendly_name, size, filepath, 0, prereqs, -1, dep_closure,
+                                                 hashes[i], db.aliasOf[i]));
+  }
+  auto uuid_vec = fbb.CreateVectorOfStructs(uuids);
+  auto info_vec = fbb.CreateVector(infos);
+  hart::fb::FinishResourceListBuffer(fbb, hart::fb::CreateResourceList(fbb, uuid_vec, info_vec, 0, !opts.unsorted));
+  return writeFile("/data/resourcedb.bin", fbb.GetBufferPointer(), fbb.GetSize());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Measurements
+//////////////////////////////////////////////////////////////////////////
+
+static float percentile(hstd::vector<float>* samples, float p) {
+  if (samples->empty()) return 0.f;
+  std::sort(samples->begin(), samples->end());
+  return (*samples)[(size_t)((samples->size() - 1) * p)];
+}
+
+static void measureLookups(Options const& opts, SyntheticDB const& db) {
+  static const uint32_t batchSize = 1024;
+  Random                rnd(opts.seed ^ 0x100C);
+  for (uint32_t miss = 0; miss < 2; ++miss) {
+    hstd::vector<hresmgr::resid_t> ids(batchSize);
+    hstd::vector<float>            batch_ns;
+    uint32_t                       found = 0;
+    for (uint32_t done = 0; done < opts.lookups; done += batchSize) {
+      for (auto& id : ids) {
+        if (miss) {
+          id.dwords[0] = rnd.next();
+          id.dwords[1] = rnd.next();
+        } else {
+          id = db.ids[rnd.range(opts.assets)];
+        }
+      }
+      htime::Timer timer;
+      for (auto const& id : ids) {
+        found += hresmgr::checkResourceLoaded(id);
+      }
+      batch_ns.push_back(timer.elapsedMS() * 1000000.f / batchSize);
+    }
+    float mean = 0.f;
+    for (float ns : batch_ns)
+      mean += ns;
+    mean /= batch_ns.size();
+    printf("lookup (%s): %.1f ns mean, %.1f ns p50, %.1f ns p99 (per lookup, batches of %u)\n",
+           miss ? "miss" : "hit", mean, percentile(&batch_ns, .5f), percentile(&batch_ns, .99f), batchSize);
+    (void)found;
+  }
+}
+
+// Unique slots needed to load roots and the bytes they read
+static void closure(SyntheticDB const& db, hstd::vector<uint32_t> const& roots, hstd::vector<uint32_t>* o_slots,
+                    uint64_t* o_bytes) {
+  hstd::vector<uint8_t>  seen(db.ids.size());
+  hstd::vector<uint32_t> stack(roots);
+  *o_bytes = 0;
+  while (!stack.empty()) {
+    // An alias loads its canonical asset, count that once
+    uint32_t slot = db.canonical(stack.back());
+    stack.pop_back();
+    if (seen[slot]) continue;
+    seen[slot] = 1;
+    o_slots->push_back(slot);
+    *o_bytes += db.sizes[slot];
+    stack.insert(stack.end(), db.prerequisites[slot].begin(), db.prerequisites[slot].end());
+  }
+}
+
+static float longestUpdateMS; // during the last pumpUntil()
+
+static void pumpUntil(hstd::function<bool()> const& done, uint32_t* o_updates) {
+  *o_updates = 0;
+  longestUpdateMS = 0.f;
+  while (!done()) {
+    htime::Timer timer;
+    hresmgr::update();
+    longestUpdateMS = hutil::tmax(longestUpdateMS, timer.elapsedMS());
+    ++*o_updates;
+  }
+}
+
+// Done once every transaction has completed. A handle can resolve before its own transaction has finished when
+// another load of the same resource got there first, and its unload then sits behind the rest of that transaction.
+// Returns the time spent queueing the loads.
+static float loadRoots(SyntheticDB const& db, hstd::vector<uint32_t> const& roots,
+                       hstd::vector<hresmgr::HandleBase>* handles, uint32_t* o_updates) {
+  htime::Timer timer;
+  uint32_t     completed = 0;
+  for (uint32_t i = 0, n = (uint32_t)roots.size(); i < n; ++i) {
+    hresmgr::loadResource(db.ids[roots[i]], &(*handles)[i], hresmgr::LoadPriority::Visible,
+                          [&completed](hresmgr::HandleBase*) { ++completed; });
+  }
+  float queue_ms = timer.elapsedMS();
+  pumpUntil([&]() { return completed == roots.size(); }, o_updates);
+  return queue_ms;
+}
+
+static void measurePass(Options const& opts, SyntheticDB const& db, uint32_t pass) {
+  Random                 rnd(opts.seed ^ (0x10AD + pass));
+  hstd::vector<uint32_t> roots(opts.roots);
+  auto const&            top = db.levels[opts.depth].empty() ? db.levels[0] : db.levels[opts.depth];
+  for (auto& r : roots)
+    r = top[rnd.range((uint32_t)top.size())];
+  hstd::vector<uint32_t> slots;
+  uint64_t               bytes;
+  closure(db, roots, &slots, &bytes);
+
+  hstd::vector<hresmgr::HandleBase> handles(opts.roots);
+  int32_t                           constructed = hatomic::atomicGet(constructedObjects);
+  uint32_t                          updates;
+  htime::Timer                      timer;
+  float                             queue_ms = loadRoots(db, roots, &handles, &updates);
+  float                             load_ms = timer.elapsedMS();
+  uint32_t                          loaded = hatomic::atomicGet(constructedObjects) - constructed;
+  printf("pass %u load: %u roots, %zu resources (%u from disk, %zu cache hits), %.2f MB in %.2f ms "
+         "(queue %.2f ms, %u updates)\n",
+         pass, opts.roots, slots.size(), loaded, slots.size() - loaded, bytes / (1024.f * 1024.f), load_ms, queue_ms,
+         updates);
+  printf("pass %u load: %.0f resources/s, %.2f MB/s, %.2f us per update, longest update %.2f ms\n", pass,
+         slots.size() * 1000.f / load_ms, bytes / (1024.f * 1024.f) / (load_ms / 1000.f),
+         load_ms * 1000.f / hutil::tmax(updates, 1u), longestUpdateMS);
+
+  timer.reset();
+  for (auto& h : handles) {
+    hresmgr::unloadResource(&h);
+  }
+  if (opts.cacheKB) {
+    // Nothing is destroyed until a type is over budget, one update releases the references
+    hresmgr::update();
+    updates = 1;
+  } else {
+    // Done once every object has been destroyed and freed
+    pumpUntil([]() { return hatomic::atomicGet(liveObjects) == 0; }, &updates);
+  }
+  float unload_ms = timer.elapsedMS();
+  printf("pass %u unload: %.2f ms, %.2f us per resource, %u updates, %d objects still cached\n", pass, unload_ms,
+         unload_ms * 1000.f / hutil::tmax<size_t>(slots.size(), 1), updates, hatomic::atomicGet(liveObjects));
+}
+
+#if HART_DEBUG_INFO
+// Rewrite payloads of loaded resources and time from the write completing to the resource manager swapping in the new
+// data (and that of the dependents pointing into it).
+static void measureHotReload(Options const& opts, SyntheticDB const& db) {
+  Random                 rnd(opts.seed ^ 0x4E10AD);
+  hstd::vector<uint32_t> roots(opts.roots);
+  auto const&            top = db.levels[opts.depth].empty() ? db.levels[0] : db.levels[opts.depth];
+  for (auto& r : roots)
+    r = top[rnd.range((uint32_t)top.size())];
+  hstd::vector<uint32_t> slots;
+  uint64_t               bytes;
+  closure(db, roots, &slots, &bytes);
+
+  hstd::vector<hresmgr::HandleBase> handles(opts.roots);
+  uint32_t                          updates;
+  loadRoots(db, roots, &handles, &updates);
+
+  hstd::vector<float>   latency_ms;
+  hstd::vector<uint8_t> payload;
+  uint32_t              reloaded = 0, missed = 0;
+  for (uint32_t i = 0; i < opts.reloads; ++i) {
+    uint32_t slot = slots[rnd.range((uint32_t)slots.size())];
+    int32_t  constructed = hatomic::atomicGet(constructedObjects);
+    if (!writePayload(db, slot, &rnd, &payload)) break;
+    // The change is noticed on a later update, once the OS has delivered it
+    htime::Timer timer;
+    while (hatomic::atomicGet(constructedObjects) == constructed && timer.elapsedMS() < 1000.f) {
+      hresmgr::update();
+    }
+    if (hatomic::atomicGet(constructedObjects) == constructed) {
+      ++missed;
+      continue;
+    }
+    latency_ms.push_back(timer.elapsedMS());
+    reloaded += hatomic::atomicGet(constructedObjects) - constructed;
+  }
+  float mean = 0.f;
+  for (float ms : latency_ms)
+    mean += ms;
+  mean /= hutil::tmax<size_t>(latency_ms.size(), 1);
+  printf("hot reload: %u edits (%u missed), write to swap %.3f ms mean, %.3f ms p50, %.3f ms p99, "
+         "%.1f resources reloaded per edit\n",
+         opts.reloads, missed, mean, percentile(&latency_ms, .5f), percentile(&latency_ms, .99f),
+         reloaded / hutil::tmax<float>((float)latency_ms.size(), 1.f));
+
+  for (auto& h : handles) {
+    hresmgr::unloadResource(&h);
+  }
+  if (opts.cacheKB) {
+    hresmgr::update();
+  } else {
+    pumpUntil([]() { return hatomic::atomicGet(liveObjects) == 0; }, &updates);
+  }
+}
+#endif
+
+static void usage() {
+  printf("resmgrbench [options]\n"
+         "  --assets N        assets in the DB (default 10000)\n"
+         "  --types N         dummy object types (default 4)\n"
+         "  --fanin N         prerequisites per asset (default 2)\n"
+         "  --depth N         levels of prerequisites (default 4)\n"
+         "  --minsize N       smallest payload in bytes (default 64)\n"
+         "  --maxsize N       largest payload in bytes (default 4096)\n"
+         "  --roots N         loads per pass (default 1000)\n"
+         "  --passes N        load/unload passes (default 2)\n"
+         "  --lookups N       lookups to time (default 1000000)\n"
+         "  --cachekb N       per type cache budget in KB (default 0)\n"
+         "  --reloads N       payload edits to hot reload, debug builds only (default 0)\n"
+         "  --dupes N         percentage of assets duplicating another asset's payload (default 0)\n"
+         "  --unloadms F      destroy budget per update (default 1.0)\n"
+         "  --loadms F        main thread load budget per update (default 2.0)\n"
+         "  --workers N       task graph workers (default 4)\n"
+         "  --seed N          generator seed (default 1)\n"
+         "  --unsorted        write a DB without sorted UUIDs\n"
+         "  --noclosure       write a DB without flattened dependency lists\n"
+         "  --reuse           reuse an existing DB written with the same options\n"
+         "  --shared          use the shared cache, run several at once to share payloads\n"
+         "  --dir PATH        where to write the DB (default resmgrbench_data)\n"
+         "  --metrics PATH    dump resource manager metrics JSON, relative to --dir\n");
+}
+
+int main(int argc, char* argv[]) {
+  static const option longOptions[] = {
+    {"assets", required_argument, nullptr, 'a'},  {"types", required_argument, nullptr, 't'},
+    {"fanin", required_argument, nullptr, 'f'},   {"depth", required_argument, nullptr, 'd'},
+    {"minsize", required_argument, nullptr, 'm'}, {"maxsize", required_argument, nullptr, 'M'},
+    {"roots", required_argument, nullptr, 'r'},   {"passes", required_argument, nullptr, 'p'},
+    {"lookups", required_argument, nullptr, 'l'}, {"cachekb", required_argument, nullptr, 'c'},
+    {"unloadms", required_argument, nullptr, 'u'}, {"workers", required_argument, nullptr, 'w'},
+    {"seed", required_argument, nullptr, 's'},    {"unsorted", no_argument, nullptr, 'U'},
+    {"reuse", no_argument, nullptr, 'R'},         {"dir", required_argument, nullptr, 'D'},
+    {"metrics", required_argument, nullptr, 'j'}, {"reloads", required_argument, nullptr, 'e'},
+    {"noclosure", no_argument, nullptr, 'C'},     {"loadms", required_argument, nullptr, 'L'},
+    {"dupes", required_argument, nullptr, 'P'},   {"shared", no_argument, nullptr, 'S'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0},
+  };
+  Options opts;
+  int     c;
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  while ((c = gop_getopt_long(argc, argv, "h", longOptions, nullptr)) != -1) {
+    switch (c) {
+    case 'a': opts.assets = hcrt::atoi(optarg); break;
+    case 't': opts.types = hcrt::atoi(optarg); break;
+    case 'f': opts.fanin = hcrt::atoi(optarg); break;
+    case 'd': opts.depth = hcrt::atoi(optarg); break;
+    case 'm': opts.minSize = hcrt::atoi(optarg); break;
+    case 'M': opts.maxSize = hcrt::atoi(optarg); break;
+    case 'r': opts.roots = hcrt::atoi(optarg); break;
+    case 'p': opts.passes = hcrt::atoi(optarg); break;
+    case 'l': opts.lookups = hcrt::atoi(optarg); break;
+    case 'c': opts.cacheKB = hcrt::atoi(optarg); break;
+    case 'u': opts.unloadMS = hcrt::atof(optarg); break;
+    case 'L': opts.loadMS = hcrt::atof(optarg); break;
+    case 'w': opts.workers = hcrt::atoi(optarg); break;
+    case 's': opts.seed = hcrt::strtoul(optarg, nullptr, 10); break;
+    case 'U': opts.unsorted = true; break;
+    case 'C': opts.noClosure = true; break;
+    case 'R': opts.reuse = true; break;
+    case 'S': opts.shared = true; break;
+    case 'D': opts.dir = optarg; break;
+    case 'j': opts.metrics = optarg; break;
+    case 'e': opts.reloads = hcrt::atoi(optarg); break;
+    case 'P': opts.dupes = hcrt::atoi(optarg); break;
+    default: usage(); return c == 'h' ? 0 : 1;
+    }
+  }
+  opts.assets = hutil::tmax(opts.assets, 1u);
+  opts.types = hutil::tmin(hutil::tmax(opts.types, 1u), 100u);
+  opts.maxSize = hutil::tmax(opts.maxSize, opts.minSize);
+
+  // Everything lives under --dir, mounted as the root
+  char native_root[HART_MAX_PATH];
+  minfs_create_directories(opts.dir);
+  if (!minfs_canonical_path(opts.dir, native_root, sizeof(native_root) - 1)) {
+    printf("Can't resolve %s\n", opts.dir);
+    return 1;
+  }
+  hcrt::strcat(native_root, sizeof(native_root) - hcrt::strlen(native_root) - 1, "/");
+  hfs::mountPoint(native_root, "/");
+
+  htime::initialise();
+  htime::Timer timer;
+  SyntheticDB  db;
+  generateGraph(opts, &db);
+  printf("generate: %u assets (%u duplicates), %u types, fan-in %u, depth %u, %u-%u bytes in %.2f ms\n", opts.assets,
+         db.aliases, opts.types, opts.fanin, opts.depth, opts.minSize, opts.maxSize, timer.elapsedMS());
+
+  char db_path[HART_MAX_PATH];
+  hcrt::sprintf(db_path, sizeof(db_path), "%sdata/resourcedb.bin", native_root);
+  if (!opts.reuse || !minfs_is_file(db_path)) {
+    timer.reset();
+    if (!writeDB(opts, native_root, db)) return 1;
+    printf("write: %.2f ms\n", timer.elapsedMS());
+  }
+
+  char config[512];
+  int  config_len = hcrt::sprintf(config, sizeof(config),
+                                  "[resourcemanager]\ncachebudgetkb=%u\nunloadbudgetms=%f\nloadbudgetms=%f\n"
+                                  "loadtraces=false\nhotreload=%s\nsharedcache=%s\nsharedcacheminkb=0\n",
+                                  opts.cacheKB, opts.unloadMS, opts.loadMS, opts.reloads ? "true" : "false",
+                                  opts.shared ? "true" : "false");
+  hconfigopt::loadConfigOptions(config, config_len);
+  registerDummyTypes(opts.types);
+  htasks::scheduler::initialise(opts.workers, 256);
+
+  timer.reset();
+  if (!hresmgr::initialise()) {
+    printf("Failed to open %s\n", db_path);
+    return 1;
+  }
+  printf("init: %.3f ms (%s DB)\n", timer.elapsedMS(), opts.unsorted ? "unsorted" : "sorted");
+
+  measureLookups(opts, db);
+  for (uint32_t pass = 0; pass < opts.passes; ++pass) {
+    measurePass(opts, db, pass);
+  }
+  if (opts.reloads) {
+#if HART_DEBUG_INFO
+    measureHotReload(opts, db);
+#else
+    printf("hot reload: skipped, needs a debug build\n");
+#endif
+  }
+  if (opts.cacheKB) {
+    uint32_t updates;
+    timer.reset();
+    hresmgr::purgeCache();
+    pumpUntil([]() { return hatomic::atomicGet(liveObjects) == 0; }, &updates);
+    printf("purge: %.2f ms, %u updates\n", timer.elapsedMS(), updates);
+  }
+
+  if (opts.metrics && !hresmgr::dumpMetrics(opts.metrics)) {
+    printf("Failed to write metrics to %s\n", opts.metrics);
+  }
+  hresmgr::shutdown();
+  htasks::scheduler::destroy();
+  return 0;
+}
@@ -282,6 +282,7 @@ def main():
                     asset['processoptions'][k] = v
                 for k, v in asset['assetmetadata']['processoptions'].iteritems():
                     asset['processoptions'][k] = v
+                FriendlyNames[final_fname]['bundled'] = asset['processoptions'].get('bundled', False)
 
                 asset_root, _ = os.path.split(asset['assetpath'])
                 asset['assetmetadata']['inputs'] = [os.path.realpath(os.path.join(asset_root, inp)) for inp in asset['assetmetadata']['inputs']]
@@ -0,0 +1,83 @@
+##
+## Create a pack archive from a directory tree, the layout is described in hart/include/hart/base/pack.h
+##
+## python create_pack.py <input directory> <output pack>
+##
+import sys
+import os
+import struct
+import hashlib
+import filecmp
+
+PACK_MAGIC = b'HPAK'
+PACK_VERSION = 1
+PACK_ENTRY_DIR = 0x1
+DATA_ALIGNMENT = 16
+
+HEADER = struct.Struct('<4sIII')
+ENTRY = struct.Struct('<IIIIIIQQq')
+
+def to_bytes(s):
+    return s if isinstance(s, bytes) else s.encode('utf-8')
+
+def gather_entries(root):
+    # Breadth first, so each directory's children are contiguous. Sorted by their bytes, as the runtime compares them
+    entries = [{'name': b'', 'path': root, 'dir': True}]
+    i = 0
+    while i < len(entries):
+        e = entries[i]
+        i += 1
+        if not e['dir']:
+            continue
+        names = sorted(os.listdir(e['path']), key=to_bytes)
+        e['firstChild'] = len(entries)
+        e['childCount'] = len(names)
+        for n in names:
+            p = os.path.join(e['path'], n)
+            entries += [{'name': to_bytes(n), 'path': p, 'dir': os.path.isdir(p)}]
+    return entries
+
+def align(offset):
+    return (offset + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1)
+
+if __name__ == '__main__':
+    entries = gather_entries(sys.argv[1])
+
+    names = b''
+    for e in entries:
+        e['nameOffset'] = len(names)
+        names += e['name']
+
+    # Files with the same bytes, like the duplicates the resource DB aliases, are stored once and share their data
+    offset = align(HEADER.size + ENTRY.size * len(entries) + len(names))
+    stored = {}
+    for e in entries:
+        if e['dir']:
+            continue
+        e['size'] = os.path.getsize(e['path'])
+        with open(e['path'], 'rb') as fin:
+            digest = hashlib.sha1(fin.read()).digest()
+        candidates = stored.setdefault((e['size'], digest), [])
+        same = [c for c in candidates if filecmp.cmp(c['path'], e['path'], shallow=False)]
+        if same:
+            e['offset'] = same[0]['offset']
+            e['shared'] = True
+            continue
+        candidates += [e]
+        e['offset'] = offset
+        offset = align(offset + e['size'])
+
+    with open(sys.argv[2], 'wb') as f:
+        f.write(HEADER.pack(PACK_MAGIC, PACK_VERSION, len(entries), len(names)))
+        for e in entries:
+            if e['dir']:
+                f.write(ENTRY.pack(e['nameOffset'], len(e['name']), PACK_ENTRY_DIR, e['firstChild'], e['childCount'], 0, 0, 0, 0))
+            else:
+                f.write(ENTRY.pack(e['nameOffset'], len(e['name']), 0, 0, 0, 0, e['offset'], e['size'], int(os.path.getmtime(e['path']))))
+        f.write(names)
+        for e in entries:
+            if e['dir'] or e.get('shared', False):
+                continue
+            f.write(b'\0' * (e['offset'] - f.tell()))
+            with open(e['path'], 'rb') as fin:
+                f.write(fin.read())
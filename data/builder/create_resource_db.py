@@ -6,8 +6,27 @@ import json
 import os.path
 import base64
 import uuid
+import hashlib
+import filecmp
 from subprocess import Popen, PIPE
 
+BUNDLE_ALIGNMENT = 16
+
+def gather_load_order(filepath, assets_by_filepath, canonical, out, seen=None):
+    # Same order the runtime loads in, prerequisites first. Each asset appears once, after everything it depends on
+    if seen is None:
+        seen = set()
+    if filepath in seen:
+        return
+    seen.add(filepath)
+    for p in assets_by_filepath[filepath]['prerequisites']:
+        gather_load_order(canonical[p], assets_by_filepath, canonical, out, seen)
+    out += [filepath]
+
+def content_hash(filepath):
+    with open(filepath, 'rb') as f:
+        return long(hashlib.sha1(f.read()).hexdigest()[:16], 16)
+
 if __name__ == '__main__':
     with open(sys.argv[1]) as fin:
         resource_json = json.load(fin)
@@ -17,7 +36,21 @@ if __name__ == '__main__':
     l = 0;
     final_output['assetUUIDs'] = []
     final_output['assetInfos'] = []
+    # Sorted so the runtime can binary search the DB in place instead of indexing it at startup
+    final_output['sortedUUIDs'] = True
+    sorted_assets = []
     for k, i in resource_json.iteritems():
+        au = uuid.UUID(i['filepath'][0].replace('.bin', ''))
+        b = bytearray()
+        b.extend(au.bytes)
+        sorted_assets += [((
+            ((b[15]<<24) | (b[14]<<16) | (b[13]<<8) | (b[12])),
+            ((b[11]<<24) | (b[10]<<16) | (b[ 9]<<8) | (b[ 8])),
+            ((b[ 7]<<24) | (b[ 6]<<16) | (b[ 5]<<8) | (b[ 4])),
+            ((b[ 3]<<24) | (b[ 2]<<16) | (b[ 1]<<8) | (b[ 0]))), k, i)]
+    sorted_assets.sort()
+
+    for _, k, i in sorted_assets:
         au = uuid.UUID(i['filepath'][0].replace('.bin', ''))
         #final_output['assetUUIDs'] += [{'highword3': (au.int & (0xFFFFFFFF << 96) ) >> 96, 'highword2': (au.int & (0xFFFFFFFF << 64) ) >> 64, 'highword1': (au.int & (0xFFFFFFFF << 32) ) >> 32, 'lowword': (au.int & 0xFFFFFFFF)}]
         b = bytearray()
@@ -31,9 +64,59 @@ if __name__ == '__main__':
         asset_index[i['filepath'][0]] = l
         l+=1
 
-    for k, v in resource_json.iteritems():
-        full_filepath = os.path.join(os.path.split(sys.argv[1])[0], v['filepath'][0])
-        final_output['assetInfos'] += [{'friendlyName': k, 'filepath': '/data/'+v['filepath'][0], 'filesize': os.path.getsize(full_filepath), 'mtime': long(os.path.getmtime(full_filepath)), 'prerequisites': [asset_index[x] for x in v['prerequisites']]}]
+    # Assets with identical contents are loaded once. The first in the DB is loaded for all of them, the others are
+    # aliases of it and everything that depends on them points at it instead. Identical contents include the UUIDs of
+    # any prerequisites, so the shared object is the same whichever asset asked for it.
+    output_dir = os.path.split(sys.argv[1])[0]
+    hashes = {}
+    canonical = {}
+    by_hash = {}
+    for _, k, v in sorted_assets:
+        fp = v['filepath'][0]
+        full_filepath = os.path.join(output_dir, fp)
+        hashes[fp] = content_hash(full_filepath)
+        # The hash is truncated, so only a file with the same bytes is aliased. Files that merely collide load their own.
+        candidates = by_hash.setdefault(hashes[fp], [])
+        same = [c for c in candidates if filecmp.cmp(os.path.join(output_dir, c), full_filepath, shallow=False)]
+        if not same:
+            candidates += [fp]
+        canonical[fp] = same[0] if same else fp
+
+    # Bundled assets get every file a load of them reads written into one file, so it's one read at runtime
+    assets_by_filepath = dict((v['filepath'][0], v) for v in resource_json.itervalues())
+    bundled = set(canonical[v['filepath'][0]] for v in resource_json.itervalues() if v.get('bundled', False))
+    bundle_index = {}
+    final_output['bundles'] = []
+    for _, k, v in sorted_assets:
+        if v['filepath'][0] not in bundled:
+            continue
+        members = []
+        gather_load_order(v['filepath'][0], assets_by_filepath, canonical, members)
+        bundle_filepath = os.path.splitext(v['filepath'][0])[0]+'.bundle'
+        offsets = []
+        with open(os.path.join(output_dir, bundle_filepath), 'wb') as f:
+            for m in members:
+                f.write('\0' * (-f.tell() % BUNDLE_ALIGNMENT))
+                offsets += [f.tell()]
+                with open(os.path.join(output_dir, m), 'rb') as mf:
+                    f.write(mf.read())
+            bundle_size = f.tell()
+        bundle_index[v['filepath'][0]] = len(final_output['bundles'])
+        final_output['bundles'] += [{'filepath': '/data/'+bundle_filepath, 'filesize': bundle_size, 'members': [asset_index[x] for x in members], 'offsets': offsets}]
+
+    for _, k, v in sorted_assets:
+        fp = canonical[v['filepath'][0]]
+        full_filepath = os.path.join(output_dir, fp)
+        # Prerequisites keep their positions, deserialisers look them up by index
+        asset_info = {'friendlyName': k, 'filepath': '/data/'+fp, 'filesize': os.path.getsize(full_filepath), 'mtime': long(os.path.getmtime(full_filepath)), 'prerequisites': [asset_index[canonical[x]] for x in v['prerequisites']], 'bundle': bundle_index.get(fp, -1), 'contentHash': hashes[fp]}
+        if fp != v['filepath'][0]:
+            asset_info['aliasOf'] = asset_index[fp]
+        # Flattened so the runtime queues a load by copying one array instead of walking the graph
+        elif v['prerequisites']:
+            load_order = []
+            gather_load_order(fp, assets_by_filepath, canonical, load_order)
+            asset_info['dependencyClosure'] = [asset_index[x] for x in load_order]
+        final_output['assetInfos'] += [asset_info]
 
     with open(sys.argv[1]+'.fbs.src', 'wb') as f:
         f.write(json.dumps(final_output, indent=2, sort_keys=True))
@@ -13,7 +13,7 @@
     uc = (wchar_t*)alloca((strlen(utf8)+1+pad)*sizeof(minfs_uint16_t)); \
     utf8_to_uc2(utf8, uc, (strlen(utf8)+1+pad)*sizeof(minfs_uint16_t));    
 
-#define UTF8_WRITABLE_STACK(utf8, out) char* out = alloca((strlen(utf8)+1)*sizeof(char))
+#define UTF8_WRITABLE_STACK(utf8, out) char* out = strcpy((char*)alloca((strlen(utf8)+1)*sizeof(char)), utf8)
 
 minfs_uint32_t utf8_codepoint(const char* uft8In, minfs_uint16_t* ucOut);
 void utf8_to_uc2(const char* src, minfs_uint16_t* dst, size_t len);
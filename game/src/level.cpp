@@ -28,7 +28,7 @@ bool Tileset::deserialiseObject(MarshallType const* in_data, hobjfact::Serialise
   margin = in_data->margin();
   firstGID = in_data->firstgid();
 
-  hresmgr::weakGetResource(huuid::fromData(*in_data->imageasset()), &textureResource);
+  params.resdata->findPrerequisite(huuid::fromData(*in_data->imageasset()), &textureResource);
 
   auto const* in_animations = in_data->animations();
   animations.resize(in_animations->size());
@@ -99,7 +99,7 @@ bool Level::deserialiseObject(MarshallType const* in_data, hobjfact::SerialisePa
   entities.resize(in_entities->size());
   for (uint32_t i = 0, n = in_entities->size(); i < n; ++i) {
     entities[i].id = (*in_entities)[i]->levelid();
-    hresmgr::weakGetResource(huuid::fromData(*(*in_entities)[i]->assetuuid()), &entities[i].entity);
+    params.resdata->findPrerequisite(huuid::fromData(*(*in_entities)[i]->assetuuid()), &entities[i].entity);
   }
 
   // Build our layer tiles. 32x32 each. Two for each layer; one static, one dynamic.
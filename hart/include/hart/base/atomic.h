@@ -14,6 +14,8 @@ typedef std::atomic<int32_t>  aint32_t;
 typedef std::atomic<uint32_t> auint32_t;
 typedef std::atomic<int64_t>  aint64_t;
 typedef std::atomic<uint64_t> auint64_t;
+template <typename t_ty>
+using aptr_t = std::atomic<t_ty*>;
 
 int32_t increment(aint32_t& i);
 int32_t decrement(aint32_t& i);
@@ -24,6 +26,15 @@ int32_t atomicAdd(aint32_t& i, int32_t amount);
 int32_t atomicAddWithPrev(aint32_t& i, int32_t amount, int32_t* prev);
 void liteMemoryBarrier();
 void heavyMemoryBarrier();
+
+template <typename t_ty>
+inline t_ty* atomicGet(const aptr_t<t_ty>& p) {
+  return p.load();
+}
+template <typename t_ty>
+inline t_ty* atomicSet(aptr_t<t_ty>& p, t_ty* val) {
+  return p.exchange(val);
+}
 }
 }
 
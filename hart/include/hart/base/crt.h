@@ -4,12 +4,16 @@
 *********************************************************************/
 #pragma once
 
+#include "hart/config.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <math.h>
+#if (HART_PLATFORM == HART_PLATFORM_WINDOWS)
+#include <malloc.h>
+#endif
 
 namespace hart {
 namespace crt {
@@ -33,9 +37,43 @@ inline int memcmp(const void* lhs, const void* rhs, size_t size) {
   return ::memcmp(lhs, rhs, size);
 }
 
+// alignment must be a power of two. Free with alignedFree
+inline void* alignedMalloc(size_t size, size_t alignment) {
+#if (HART_PLATFORM == HART_PLATFORM_WINDOWS)
+  return ::_aligned_malloc(size, alignment);
+#elif (HART_PLATFORM == HART_PLATFORM_LINUX)
+  void* ptr = nullptr;
+  return ::posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) == 0 ? ptr : nullptr;
+#else
+#error("Unknown platform")
+#endif
+}
+
+inline void alignedFree(void* ptr) {
+#if (HART_PLATFORM == HART_PLATFORM_WINDOWS)
+  ::_aligned_free(ptr);
+#elif (HART_PLATFORM == HART_PLATFORM_LINUX)
+  ::free(ptr);
+#else
+#error("Unknown platform")
+#endif
+}
+
 // return zero on success
 inline int strcpy(char* dst, size_t dstsize, char const* src) {
+#if (HART_PLATFORM == HART_PLATFORM_WINDOWS)
   return ::strcpy_s(dst, dstsize, src);
+#elif (HART_PLATFORM == HART_PLATFORM_LINUX)
+  size_t len = ::strlen(src);
+  if (len >= dstsize) {
+    if (dstsize) *dst = 0;
+    return -1;
+  }
+  ::memcpy(dst, src, len + 1);
+  return 0;
+#else
+#error("Unknown platform")
+#endif
 }
 
 inline size_t strlen(const char* s1) {
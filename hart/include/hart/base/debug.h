@@ -16,7 +16,7 @@
 
 
 #if (HART_PLATFORM == HART_PLATFORM_LINUX)
-#define __noop(...)
+#define __noop ((void)0)
 #endif
 
 #if HART_DO_ASSERTS
@@ -95,8 +95,12 @@ inline void outputdebugstring(char const* fmt_str, ...) {
   va_list args;
   va_start(args, fmt_str);
 #if HART_ENABLE_PROFILE
-  char tmp_buffer[1024];
-  hcrt::vsprintf(tmp_buffer, 1024, fmt_str, args);
+  // args is used again below, so format from a copy
+  char    tmp_buffer[1024];
+  va_list profile_args;
+  va_copy(profile_args, args);
+  hcrt::vsprintf(tmp_buffer, 1024, fmt_str, profile_args);
+  va_end(profile_args);
   hprofile_log(tmp_buffer);
 #endif
 #if HART_ENABLE_STDIO
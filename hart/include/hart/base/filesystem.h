@@ -21,6 +21,14 @@ enum class Error {
   EndOfFile,
 };
 
+enum OpenFlags {
+  // Bypass the OS file cache. Reads and writes whose buffer and offset are multiples of directAlignment() go to the
+  // device for the aligned part of their size, the rest goes through the cache. Anything unaligned, or a file system
+  // without direct I/O, quietly goes through the cache. A read running past the end of the file may change the part of
+  // the buffer after the data.
+  OpenFlag_Direct = 0x1,
+};
+
 enum class FileEntryType {
   Dir = 0x80,
   File = 0x40,
@@ -34,8 +42,10 @@ struct FileInfo {
 };
 
 
-typedef struct File*   FileHandle;
-typedef struct FileOp* FileOpHandle;
+typedef struct File*            FileHandle;
+typedef struct FileOp*          FileOpHandle;
+typedef struct Watch*           WatchHandle;
+typedef struct CompletionQueue* CompletionQueueHandle;
 
 struct FileInfo2 {
   const char* path_;
@@ -48,6 +58,53 @@ struct FileStat {
   time_t   modifiedDate;
 };
 
+enum class MapHint {
+  Normal,
+  Sequential, // read ahead aggressively and drop pages behind
+  Random,     // don't read ahead
+  WillNeed,   // start reading the range in now
+};
+
+// Part of a file to map. A size of 0 maps to the end of the file, a range past the end is cut short.
+struct MapRange {
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  MapHint  hint = MapHint::Normal;
+  bool     prefault = false; // read in every page before returning, so touching the view never waits on the disk
+};
+
+// Read only view of a file, or of part of one
+struct MappedView {
+  void const* data = nullptr;
+  uint64_t    size = 0;
+  void*       platform = nullptr; // owned by the filesystem
+};
+
+// View of named memory shared with other processes on this machine
+struct SharedMemory {
+  void*    data = nullptr;
+  uint64_t size = 0; // may be rounded up to a page
+  void*    platform = nullptr; // owned by the filesystem
+};
+
+// One read of a batch, see freadAsyncBatch()
+struct ReadRequest {
+  FileHandle file;
+  uint64_t   offset;
+  size_t     size;
+  void*      buffer;
+};
+
+// A finished op posted to a completion queue. The op has already been freed, it only tells completions apart.
+struct Completion {
+  FileOpHandle op;
+  Error        result;
+  void*        userData;
+};
+
+// Called on an hfs I/O thread as an op finishes, or on the posting thread if it already had. Shouldn't block.
+typedef void (*CompletionCallback)(Completion const& completion);
+
 struct DirEntry {
   char     filename[HART_MAX_PATH];
   uint32_t typeFlags; // of FileEntryType
@@ -58,8 +115,16 @@ bool initialise_filesystem();
 Error fileOpComplete(FileOpHandle);
 Error fileOpWait(FileOpHandle);
 
-FileOpHandle openFile(const char* filename, Mode mode, FileHandle* outhandle);
-void         closeFile(FileHandle);
+// Opens, stats, closes and directory listings are done by the I/O backend like reads, so none of them wait on the OS.
+// Opens write the handle to outhandle as they complete, null if they failed, so it must outlive the op.
+FileOpHandle openFile(const char* filename, Mode mode, FileHandle* outhandle, uint32_t flags = 0); // of OpenFlags
+
+// Buffers for files opened with OpenFlag_Direct. Sizes are rounded up to a multiple of directAlignment().
+size_t directAlignment();
+void*  allocDirectBuffer(size_t size);
+void   freeDirectBuffer(void* buffer);
+void         closeFile(FileHandle); // returns at once, the OS handle is closed in the background
+// Lists the whole directory, readDir() then hands out the entries without waiting
 FileOpHandle openDir(const char* path, FileHandle* outhandle);
 FileOpHandle readDir(FileHandle dir, DirEntry* out);
 void closeDir(FileHandle dir);
@@ -67,8 +132,46 @@ void closeDir(FileHandle dir);
 FileOpHandle freadAsync(FileHandle file, void* buffer, size_t size, uint64_t offset);
 FileOpHandle fwriteAsync(FileHandle file, const void* buffer, size_t size, uint64_t offset);
 FileOpHandle fstatAsync(FileHandle file, FileStat* out);
+// One op for many reads, submitted together. Reads of adjacent ranges of a file may be merged into one. Completes once
+// every read has, Failed if any read failed, otherwise EndOfFile if any read started at or past the end of its file.
+FileOpHandle freadAsyncBatch(ReadRequest const* reads, uint32_t count);
+
+// Rather than polling each op, post it to a queue and pop whatever has finished. Once posted an op mustn't be polled or
+// waited on. queue can be null when there's a callback. Every op posted to a queue must finish before it's destroyed.
+CompletionQueueHandle createCompletionQueue();
+void                  destroyCompletionQueue(CompletionQueueHandle queue);
+void     fileOpPost(FileOpHandle op, CompletionQueueHandle queue, void* user_data, CompletionCallback callback = nullptr);
+uint32_t popCompletions(CompletionQueueHandle queue, Completion* out, uint32_t max); // never blocks
+uint32_t waitCompletions(CompletionQueueHandle queue, Completion* out, uint32_t max); // blocks until there's one
+
+bool mapFile(const char* filename, MappedView* out);
+bool mapFile(const char* filename, MapRange const& range, MappedView* out);
+void unmapFile(MappedView* view);
+// offset and size are within the view, a size of 0 meaning to its end
+void adviseMappedView(MappedView const* view, uint64_t offset, uint64_t size, MapHint hint);
+
+// Shared memory names are plain, no path separators. createSharedMemory() fails if the name is already in use and gives
+// a writable view. openSharedMemory() gives a read only view. Linux only opens memory created by the same user, Windows
+// names live in the session's Local namespace, so any process in the session can open them. Linux keeps the memory
+// until it's removed, Windows until the last view of it is closed in any process.
+bool createSharedMemory(const char* name, uint64_t size, SharedMemory* out);
+bool openSharedMemory(const char* name, SharedMemory* out);
+void closeSharedMemory(SharedMemory* shm);
+void removeSharedMemory(const char* name);
+
+// Watches a directory tree for files that are written, created or moved in. Polled, never blocks.
+WatchHandle watchDirectory(const char* path);
+// Pops the next changed file. filename is relative to the watched directory and uses '/' separators. The same file
+// may be reported more than once for a single change. Returns false when there is nothing left to report.
+bool readWatch(WatchHandle watch, DirEntry* out);
+void closeWatch(WatchHandle watch);
 
 void mountPoint(const char* path, const char* mount);
+// Serves the files in a pack archive (see hart/base/pack.h) under mount. Its directory index is read into memory here,
+// so opening, stat-ing and listing anything under mount makes no system calls, and reads go to the file's offset in
+// the archive. Files under a pack mount are read only. pack_path is expanded through the mounts already made, and the
+// mount is removed with unmountPoint().
+bool mountPack(const char* pack_path, const char* mount);
 void unmountPoint(const char* mount);
 bool isAbsolutePath(const char* path);
 void getCurrentWorkingDir(char* out, uint32_t bufsize);
@@ -0,0 +1,61 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file LICENSE.txt in the repository root directory.
+*********************************************************************/
+#pragma once
+// Pack archives, many files in one served by hfs::mountPack(). Written by data/builder/create_pack.py, little endian:
+//   PackHeader
+//   PackEntry[entryCount] entries[0] is the root directory, each directory's children are contiguous and sorted by name
+//   char[namesSize]       entry names, not terminated
+//   file data, at each file's offset
+
+#include "hart/config.h"
+#include "hart/base/std.h"
+#include "hart/base/util.h"
+
+namespace hart {
+namespace filesystem {
+
+static const uint32_t packMagic = HART_MAKE_FOURCC('H', 'P', 'A', 'K');
+static const uint32_t packVersion = 1;
+
+struct PackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t namesSize;
+};
+
+enum PackEntryFlags {
+  PackEntry_Dir = 0x1,
+};
+
+struct PackEntry {
+  uint32_t name; // into the names
+  uint32_t nameLen;
+  uint32_t flags; // of PackEntryFlags
+  uint32_t firstChild; // directories only
+  uint32_t childCount;
+  uint32_t reserved;
+  uint64_t offset; // files only, from the start of the archive
+  uint64_t size;
+  int64_t  mtime; // seconds since the epoch
+};
+
+// An archive's directory tree, held in memory so looking up a path never touches the archive
+struct PackIndex {
+  hstd::vector<PackEntry> entries;
+  hstd::string            names;
+
+  // Size of the header and index at the start of an archive
+  static uint64_t indexSize(PackHeader const& header);
+  // index is the first indexSize() bytes of an archive archive_size bytes long. Fails on anything that would send a
+  // lookup or a read out of bounds.
+  bool load(void const* index, uint64_t archive_size);
+  // path is relative to the root with '/' separators, empty and '.' components are skipped. Null if not found.
+  PackEntry const* find(const char* path) const;
+  void             getName(PackEntry const& entry, char* out, size_t max_len) const;
+};
+
+}
+}
@@ -3,6 +3,10 @@
     Please see the file LICENSE.txt in the repository root directory.
 *********************************************************************/
 #pragma once
+
+#include "hart/config.h"
+#include <utility>
+
 namespace hart {
 namespace util {
 
@@ -29,6 +29,9 @@
 #if defined(_WIN32) || defined(_WIN64)
 #undef HART_PLATFORM
 #define HART_PLATFORM (HART_PLATFORM_WINDOWS)
+#elif defined(__linux__)
+#undef HART_PLATFORM
+#define HART_PLATFORM (HART_PLATFORM_LINUX)
 #else
 #error "Unable to determine platform"
 #endif
@@ -96,8 +99,8 @@
     64 bit offset_basis = 14695981039346656037
 */
 #if HART_64BIT
-#define HART_FVN_OFFSET_BASIS (14695981039346656037)
-#define HART_FVN_PRIME (1099511628211)
+#define HART_FVN_OFFSET_BASIS (14695981039346656037ull)
+#define HART_FVN_PRIME (1099511628211ull)
 #elif HART_32BIT
 #define HART_FVN_OFFSET_BASIS (2166136261)
 #define HART_FVN_PRIME (16777619)
@@ -111,6 +114,9 @@
 
 #if HART_PLATFORM == HART_PLATFORM_WINDOWS
 #define hrestrict __restrict
+#elif HART_PLATFORM == HART_PLATFORM_LINUX
+#define hrestrict __restrict__
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
@@ -48,14 +48,16 @@ class EntityTemplate {
   HART_OBJECT_TYPE(HART_MAKE_FOURCC('e', 't', 'p', 'l'), resource::EntityTemplate)
 public:
   struct ComponentTemplate {
-    uint32_t       typeCC;
-    uint8_t const* dataPtr;
+    uint32_t typeCC;
+    uint32_t dataOffset; // into componentData
   };
   hstd::vector<ComponentTemplate> componentTemplates;
+  // A copy of the file's component blobs, so the file can be released once loaded
+  hstd::vector<uint8_t> componentData;
   uint8_t const* getComponentTemplateData(uint32_t typecc) {
     for (auto const& i : componentTemplates) {
       if (i.typeCC == typecc) {
-        return i.dataPtr;
+        return componentData.data() + i.dataOffset;
       }
     }
     return nullptr;
@@ -7,6 +7,7 @@
 
 #include "hart/config.h"
 #include "hart/base/std.h"
+#include "flatbuffers/flatbuffers.h"
 #include <vector>
 
 namespace hart {
@@ -32,7 +33,7 @@ struct SerialiseParams {
   void*                                    user = nullptr;
 };
 
-template <typename t_ty, typename t_ty2 = t_ty::MarshallType>
+template <typename t_ty, typename t_ty2 = typename t_ty::MarshallType>
 struct typehelper_t {
   typedef t_ty  objType;
   typedef t_ty2 serialiserType;
@@ -65,11 +66,20 @@ typedef void (*ObjectDestructProc)(void* obj_ptr);
 typedef bool (*ObjectDeserialiseProc)(void const* src, void* dst, SerialiseParams const& p);
 typedef entity::Component* (*ObjectComponentProc)(void* mem, void const* overrides, void const* base);
 
+enum ObjectFlags {
+  // objFree may be called from a worker thread (i.e. the type doesn't use a custom, single threaded, allocator)
+  ObjectFlag_ThreadSafeFree = 0x1,
+  // deserialiseObject doesn't keep pointers into its prerequisites, so it needn't be deserialised again when one of
+  // them is hot reloaded
+  ObjectFlag_NoPrerequisitePointers = 0x2,
+};
+
 struct ObjectDefinition {
   ObjectDefinition() = default;
   ObjectDefinition(uint32_t in_typecc, const char* in_objectName, size_t in_typeSize, ObjectMallocProc in_objMalloc,
                    ObjectFreeProc in_objFree, ObjectConstructProc in_construct, ObjectDestructProc in_destruct,
-                   ObjectDeserialiseProc in_deserialise, ObjectComponentProc in_component, void* in_user)
+                   ObjectDeserialiseProc in_deserialise, ObjectComponentProc in_component, void* in_user,
+                   uint32_t in_flags = 0)
     : typecc(in_typecc),
       objectName(in_objectName),
       typeSize(in_typeSize),
@@ -79,7 +89,8 @@ struct ObjectDefinition {
       destruct(in_destruct),
       deserialise(in_deserialise),
       component(in_component),
-      user(in_user) {}
+      user(in_user),
+      flags(in_flags) {}
 
   uint32_t              typecc = 0;
   hstd::string          objectName;
@@ -91,7 +102,8 @@ struct ObjectDefinition {
   ObjectDeserialiseProc deserialise = nullptr;
   ObjectComponentProc   component = nullptr;
 
-  void* user = nullptr;
+  void*    user = nullptr;
+  uint32_t flags = 0; // of ObjectFlags
 };
 
 #define HART_OBJECT_TYPE(typecc, serialiser_type)                                                                      \
@@ -114,21 +126,28 @@ public:
 private:
 
 
-#define HART_OBJECT_TYPE_DECL_CUSTOM(type, mallocFn, freeFn, constructFn, destructFn, user)                            \
+#define HART_OBJECT_TYPE_DECL_CUSTOM_FLAGS(type, mallocFn, freeFn, constructFn, destructFn, user, flags)               \
   hobjfact::ObjectDefinition type::typeDef(type::getTypeCC(), #type, sizeof(type), mallocFn, freeFn, constructFn,      \
-                                           destructFn, hobjfact::typehelper_t<type>::deserialiseType, nullptr, user)
+                                           destructFn, hobjfact::typehelper_t<type>::deserialiseType, nullptr, user,   \
+                                           flags)
+
+#define HART_OBJECT_TYPE_DECL_CUSTOM(type, mallocFn, freeFn, constructFn, destructFn, user)                            \
+  HART_OBJECT_TYPE_DECL_CUSTOM_FLAGS(type, mallocFn, freeFn, constructFn, destructFn, user, 0)
+
+#define HART_OBJECT_TYPE_DECL_FLAGS(type, flags)                                                                       \
+  HART_OBJECT_TYPE_DECL_CUSTOM_FLAGS(                                                                                  \
+    type, hobjfact::typehelper_t<type>::mallocType, hobjfact::typehelper_t<type>::freeType,                            \
+    hobjfact::typehelper_t<type>::constructType, hobjfact::typehelper_t<type>::destructType, nullptr,                  \
+    hobjfact::ObjectFlag_ThreadSafeFree | (flags))
 
-#define HART_OBJECT_TYPE_DECL(type)                                                                                    \
-  HART_OBJECT_TYPE_DECL_CUSTOM(type, hobjfact::typehelper_t<type>::mallocType, hobjfact::typehelper_t<type>::freeType, \
-                               hobjfact::typehelper_t<type>::constructType,                                            \
-                               hobjfact::typehelper_t<type>::destructType, nullptr)
+#define HART_OBJECT_TYPE_DECL(type) HART_OBJECT_TYPE_DECL_FLAGS(type, 0)
 
 #define HART_COMPONENT_OBJECT_TYPE_DECL(type)                                                                          \
   hobjfact::ObjectDefinition type::typeDef(                                                                            \
     type::getTypeCC(), #type, sizeof(type), hobjfact::typehelper_t<type>::mallocType,                                  \
     hobjfact::typehelper_t<type>::freeType, hobjfact::typehelper_t<type>::constructType,                               \
     hobjfact::typehelper_t<type>::destructType, hobjfact::typehelper_t<type>::deserialiseType,                         \
-    hobjfact::typehelper_t<type>::constructTypeAsComponent, nullptr)
+    hobjfact::typehelper_t<type>::constructTypeAsComponent, nullptr, hobjfact::ObjectFlag_ThreadSafeFree)
 
 
 //////////////////////////////////////////////////////////////////////////
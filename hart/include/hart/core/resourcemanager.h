@@ -8,6 +8,7 @@
 #include "hart/base/uuid.h"
 #include "hart/base/debug.h"
 #include "hart/base/util.h"
+#include "hart/base/std.h"
 #include "hart/fbs/resourcecollection_generated.h"
 #include "hart/core/objectfactory.h"
 
@@ -16,28 +17,62 @@ namespace resourcemanager {
 
 typedef huuid::uuid_t resid_t;
 struct Resource;
+struct WeakHandleBase;
+
+static const uint32_t invalidSlot = ~0u;
+
+struct PrerequisiteData {
+  resid_t  id;
+  void*    data;
+  uint32_t typecc;
+};
 
 struct ResourceLoadData {
   bool        persistFileData = false;
   char const* friendlyName = nullptr;
+  // The resource's prerequisites, loaded, in the order they're listed in the resource DB
+  PrerequisiteData const* prerequisites = nullptr;
+  uint32_t                prerequisiteCount = 0;
+
+  // For types whose builder writes the prerequisite list in a known order. res_id is only used to check the index
+  void getPrerequisite(uint32_t index, resid_t const& res_id, WeakHandleBase* hdl) const;
+  // Scans the prerequisites for res_id. Anything not listed as a prerequisite is looked up with weakGetResource()
+  void findPrerequisite(resid_t const& res_id, WeakHandleBase* hdl) const;
 };
 
+// Queued loads are serviced highest priority first. The choice is made before each resource is loaded, so a
+// higher priority request can overtake one part way through loading its prerequisites.
+enum class LoadPriority : uint8_t {
+  Critical, // needed before the next frame can be drawn
+  Visible,  // needed soon, on screen or about to be
+  Prefetch, // speculative. Expected to be cancelled often
+
+  Count,
+};
+
+struct HandleBase;
+// Called from update() on the main thread once the resource and its prerequisites are loaded. Not called for
+// cancelled loads. To signal a task graph, add a task input or post a semaphore from here.
+typedef hstd::function<void(HandleBase*)> LoadCallback;
+
+// Resolving a handle (loaded(), getData()) doesn't lock. It reads the resource slot's generation and re-reads the
+// slot's data only when that has changed since the handle last looked.
 struct HandleBase {
   bool  loaded();
-  void* getDataRaw(uint32_t expected_typecc) {
-    hdbassert(data, "Asset is not loaded yet. Check with call to loaded() first.");
-    return (expected_typecc == typecc) ? data : nullptr;
-  }
-  bool valid() const { return !huuid::isNull(id); }
+  void* getDataRaw(uint32_t expected_typecc);
+  bool  valid() const { return slot != invalidSlot; }
 
 protected:
-  friend void loadResource(resid_t res_id, HandleBase* hdl);
+  friend void loadResource(resid_t res_id, HandleBase* hdl, LoadPriority priority, LoadCallback const& on_loaded);
   friend void unloadResource(HandleBase* hdl);
+  friend bool cancelLoad(HandleBase* hdl);
 
-  resid_t         id;
-  Resource const* info = nullptr;
-  void*           data = nullptr;
-  uint32_t        typecc = 0;
+  resid_t  id;
+  uint32_t slot = invalidSlot; // index into the resource table
+  int32_t  generation = 0;     // of the slot when data was read
+  void*    data = nullptr;
+  uint32_t typecc = 0;
+  uint64_t transaction = 0;
 };
 
 template <typename t_ty>
@@ -54,6 +89,7 @@ struct WeakHandleBase {
 
 protected:
   friend void weakGetResource(resid_t res_id, WeakHandleBase* hdl);
+  friend struct ResourceLoadData;
 
   void* data = nullptr;
 #if HART_DEBUG_INFO
@@ -77,11 +113,24 @@ bool initialise();
 void update();
 void shutdown();
 bool checkResourceLoaded(resid_t res_id);
-void loadResource(resid_t res_id, HandleBase* hdl);
+void loadResource(resid_t res_id, HandleBase* hdl, LoadPriority priority = LoadPriority::Visible,
+                  LoadCallback const& on_loaded = nullptr);
 void unloadResource(HandleBase* res_hdl);
+// Cancel a queued load. Anything already loaded for it is released, a resource in flight is released once it
+// finishes. The handle is reset and shouldn't be unloaded. Returns false if the load has already completed.
+bool cancelLoad(HandleBase* hdl);
 // Grabs a weak reference to loaded data. Can't be depended on to stay loaded
 // Use when it is know that the resource will not unload due to some other dependency
 void weakGetResource(resid_t res_id, WeakHandleBase* hdl);
+// Unreferenced resources stay loaded until their type is over budget. Budget defaults come from system.ini
+void setCacheBudget(uint32_t typecc, size_t bytes);
+// Destroy all unreferenced resources regardless of budget
+void purgeCache();
+// Start reading the files recorded in the load trace of res_id, if there is one. loadResource() does this too, call
+// it earlier when it's known a resource will be needed soon.
+void prefetchTrace(resid_t res_id);
+// Write per asset type load timings (queue wait, I/O, deserialise, main thread) and byte counts as JSON
+bool dumpMetrics(const char* path);
 
 class Collection {
   HART_OBJECT_TYPE(HART_MAKE_FOURCC('r', 's', 'c', 't'), fb::ResourceCollection)
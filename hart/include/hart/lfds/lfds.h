@@ -8,6 +8,8 @@
 
 #if (HART_PLATFORM == HART_PLATFORM_WINDOWS)
 #define LFDS_PLATFORM_WINDOWS (1)
+#elif (HART_PLATFORM == HART_PLATFORM_LINUX)
+#define LFDS_PLATFORM_LINUX (1)
 #else
 #error "Unknown platform"
 #endif
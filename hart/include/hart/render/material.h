@@ -58,7 +58,7 @@ public:
   MaterialInputHandle getInputParameterHandle(const char* name) {
     MaterialInputHandle r;
     for (uint16_t i = 0, n = (uint16_t)inputs.size(); i < n; ++i) {
-      if (hcrt::strcmp(inputs[i].name, name) == 0) {
+      if (hcrt::strcmp(getInputName(inputs[i]), name) == 0) {
         r.type = (uint16_t)inputs[i].dataType;
         r.idx = i;
         return r;
@@ -66,7 +66,7 @@ public:
     }
     return r;
   }
-  char const* getInputParameterName(MaterialInputHandle h) { return inputs[h.idx].name; }
+  char const* getInputParameterName(MaterialInputHandle h) { return getInputName(inputs[h.idx]); }
   uint32_t getTechnqiuePassCount(TechniqueType in_type) {
     uint32_t idx = getTechnqiueIndex(in_type);
     return (idx == InvalidIndex) ? 0 : (uint32_t)techniques[idx].passes.size();
@@ -108,7 +108,7 @@ private:
 
   struct Input {
     static const uint16_t Invalid = uint16_t(~0ul);
-    const char*           name = nullptr;
+    uint32_t              nameIdx = 0; // into inputNames
     MaterialInputData     dataType = resource::MaterialInputData_NONE;
     uint16_t              dataIdx : 15;
     uint16_t              set : 1;
@@ -116,10 +116,13 @@ private:
   };
 
 
+  char const* getInputName(Input const& in) const { return inputNames.data() + in.nameIdx; }
+
   hstd::vector<Technique>        techniques;
   hstd::vector<TextureResHandle> boundTextures;
   hstd::vector<uint8_t>          inputData;
   hstd::vector<Input>            inputs;
+  hstd::vector<char>             inputNames; // nul terminated, packed
 };
 
 class MaterialSetup {
@@ -0,0 +1,44 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file LICENSE.txt in the repository root directory.
+*********************************************************************/
+#pragma once
+
+#include "hart/config.h"
+#include <pthread.h>
+
+namespace hart {
+
+class Mutex {
+public:
+  Mutex() {
+    // Recursive to match the win32 critical section
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex_, &attr);
+    pthread_mutexattr_destroy(&attr);
+  }
+  void lock() { pthread_mutex_lock(&mutex_); }
+  bool tryLock() { return pthread_mutex_trylock(&mutex_) == 0; }
+  void unlock() { pthread_mutex_unlock(&mutex_); }
+  ~Mutex() { pthread_mutex_destroy(&mutex_); }
+
+  pthread_mutex_t mutex_;
+};
+
+class ScopedMutex {
+public:
+  ScopedMutex(Mutex* in_mtx) : mtx(in_mtx) { mtx->lock(); }
+  ~ScopedMutex() { mtx->unlock(); }
+
+  ScopedMutex& operator=(ScopedMutex const& rhs) = delete;
+  ScopedMutex(ScopedMutex const& rhs) = delete;
+
+private:
+  Mutex* mtx;
+};
+}
+
+typedef hart::Mutex       hMutex;
+typedef hart::ScopedMutex hScopedMutex;
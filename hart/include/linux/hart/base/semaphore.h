@@ -0,0 +1,37 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file LICENSE.txt in the repository root directory.
+*********************************************************************/
+#pragma once
+
+#include "hart/config.h"
+#include "hart/base/debug.h"
+#include <semaphore.h>
+#include <errno.h>
+
+namespace hart {
+class Semaphore {
+public:
+  // maxCount isn't enforced by POSIX semaphores
+  bool Create(uint32_t initCount, uint32_t maxCount) {
+    int r = sem_init(&sema, 0, initCount);
+    hdbassert(r == 0, "sem_init Failed");
+    return r == 0;
+  }
+  void Wait() {
+    while (sem_wait(&sema) != 0 && errno == EINTR) {
+    }
+  }
+  bool poll() { return sem_trywait(&sema) == 0; }
+  void Post() {
+    auto r = sem_post(&sema);
+    hdbassert(r == 0, "sem_post Failed");
+  }
+  void Destroy() { sem_destroy(&sema); }
+
+private:
+  sem_t sema;
+};
+}
+
+typedef hart::Semaphore hSemaphore;
@@ -0,0 +1,71 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file LICENSE.txt in the repository root directory.
+*********************************************************************/
+
+#include "hart/base/pack.h"
+#include "hart/base/crt.h"
+#include <algorithm>
+
+namespace hart {
+namespace filesystem {
+
+uint64_t PackIndex::indexSize(PackHeader const& header) {
+  return sizeof(PackHeader) + (uint64_t)header.entryCount * sizeof(PackEntry) + header.namesSize;
+}
+
+bool PackIndex::load(void const* index, uint64_t archive_size) {
+  PackHeader header;
+  hcrt::memcpy(&header, index, sizeof(header));
+  if (header.magic != packMagic || header.version != packVersion || header.entryCount == 0) return false;
+
+  entries.resize(header.entryCount);
+  hcrt::memcpy(entries.data(), (uint8_t const*)index + sizeof(header), header.entryCount * sizeof(PackEntry));
+  names.assign((char const*)index + sizeof(header) + header.entryCount * sizeof(PackEntry), header.namesSize);
+  if (!(entries[0].flags & PackEntry_Dir)) return false;
+  for (auto const& entry : entries) {
+    if ((uint64_t)entry.name + entry.nameLen > header.namesSize) return false;
+    if (entry.flags & PackEntry_Dir) {
+      if ((uint64_t)entry.firstChild + entry.childCount > header.entryCount) return false;
+    } else if (entry.offset > archive_size || entry.size > archive_size - entry.offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int compareName(PackIndex const& index, PackEntry const& entry, const char* name, size_t len) {
+  int r = hcrt::memcmp(index.names.data() + entry.name, name, entry.nameLen < len ? entry.nameLen : len);
+  if (r != 0) return r;
+  return entry.nameLen < len ? -1 : entry.nameLen > len ? 1 : 0;
+}
+
+// One binary search per component
+PackEntry const* PackIndex::find(const char* path) const {
+  PackEntry const* found = entries.data();
+  while (*path) {
+    const char* end = path;
+    while (*end && *end != '/')
+      ++end;
+    size_t len = end - path;
+    if (len != 0 && !(len == 1 && path[0] == '.')) {
+      if (!(found->flags & PackEntry_Dir)) return nullptr;
+      PackEntry const* first = entries.data() + found->firstChild;
+      PackEntry const* last = first + found->childCount;
+      found = std::lower_bound(first, last, path, [&](PackEntry const& entry, const char* name) {
+        return compareName(*this, entry, name, len) < 0;
+      });
+      if (found == last || compareName(*this, *found, path, len) != 0) return nullptr;
+    }
+    path = *end ? end + 1 : end;
+  }
+  return found;
+}
+
+void PackIndex::getName(PackEntry const& entry, char* out, size_t max_len) const {
+  size_t len = entry.nameLen < max_len - 1 ? entry.nameLen : max_len - 1;
+  hcrt::memcpy(out, names.data() + entry.name, len);
+  out[len] = 0;
+}
+}
+}
@@ -488,6 +488,8 @@ struct Context {
       hprofile_start(RenderFrame);
       game->render();
 #if HART_DEBUG_INFO
+      // Fetched every frame as a hot reload can replace it
+      hresmgr::weakGetResource(huuid::fromDwords(0xa5332a80b2ee414a, 0xb92e9b4c81cca292), &debugPrimsMat);
       hrnd::debug::flushAndSumbitDebugPrims(hrnd::View_Debug, debugPrimsMat.getData(), &debugView, &debugProj);
 #endif
       ImGui::Render();
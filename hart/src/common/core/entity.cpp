@@ -8,6 +8,7 @@
 #include "hart/core/objectfactory.h"
 #include "hart/core/resourcemanager.h"
 #include "hart/base/freelist.h"
+#include "hart/base/crt.h"
 
 /********************************************************************
 
@@ -57,22 +58,26 @@ HART_OBJECT_TYPE_DECL(EntityTemplate);
 HART_OBJECT_TYPE_DECL(Entity);
 
 bool EntityTemplate::deserialiseObject(MarshallType const* in_data, hobjfact::SerialiseParams const& params) {
-  params.resdata->persistFileData = true;
+  // Each component is a flatbuffer, so the copy keeps the alignment the blob had in the file
   uint8_t const* base_add = in_data->componentData()->data();
-  auto*          componentOffsets = in_data->componentOffsets();
+  uint32_t       bias = (uint32_t)((uintptr_t)base_add & 15);
+  componentData.resize(bias + in_data->componentData()->size());
+  hcrt::memcpy(componentData.data() + bias, base_add, in_data->componentData()->size());
+  auto* componentOffsets = in_data->componentOffsets();
   componentTemplates.resize(componentOffsets->size());
   for (uint32_t i = 0, n = componentOffsets->size(); i < n; ++i) {
     uint8_t const* comp_ptr = base_add + (*componentOffsets)[i];
     // Get typecc from data (see BufferHasIdentifier)
     uint32_t data_typecc = *((uint32_t*)(comp_ptr + sizeof(flatbuffers::uoffset_t)));
     componentTemplates[i].typeCC = data_typecc;
-    componentTemplates[i].dataPtr = comp_ptr;
+    componentTemplates[i].dataOffset = bias + (*componentOffsets)[i];
   }
   return true;
 }
 
 bool Entity::deserialiseObject(MarshallType const* in_data, hobjfact::SerialiseParams const& params) {
-  hresmgr::weakGetResource(huuid::fromData(*in_data->entityTemplate()), &templateEntity);
+  // update_prerequisites.py puts the template first
+  params.resdata->getPrerequisite(0, huuid::fromData(*in_data->entityTemplate()), &templateEntity);
 
   uint8_t const* base_add = in_data->componentData()->data();
   auto*          componentOffsets = in_data->componentOffsets();
@@ -33,6 +33,10 @@ bool objectFactoryRegister(ObjectDefinition const& definition, void* user) {
 
 void* deserialiseObject(void const* data, size_t len, SerialiseParams* params, uint32_t* out_typecc) {
   hdbassert(params, "params must not be null");
+  if (len < sizeof(flatbuffers::uoffset_t) + sizeof(uint32_t)) {
+    hdbfatal("Object data too short, %zu bytes", len);
+    return nullptr;
+  }
   // Get typecc from data (see BufferHasIdentifier)
   uint32_t data_typecc = *((uint32_t*)((char const*)(data) + sizeof(flatbuffers::uoffset_t)));
   // read data
@@ -11,106 +11,810 @@
 #include "hart/fbs/resourcedb_generated.h"
 #include "hart/base/mutex.h"
 #include "hart/core/engine.h"
+#include "hart/core/configoptions.h"
+#include "hart/core/taskgraph.h"
+#include "hart/base/time.h"
+#include "hart/base/util.h"
+#include <float.h>
+#include <algorithm>
+#include <new>
 
-HART_OBJECT_TYPE_DECL(hart::resourcemanager::Collection);
+// Collections only check their contents are loaded
+HART_OBJECT_TYPE_DECL_FLAGS(hart::resourcemanager::Collection, hobjfact::ObjectFlag_NoPrerequisitePointers);
 
 namespace hart {
 namespace resourcemanager {
 namespace hfb = hart::fb;
 
+// Load time file data lives in page aligned buffers from a pool owned by the resource manager. Sizes are rounded up to
+// a size class so buffers freed by one load are reused by later ones rather than churning the heap.
+static const size_t   ioPageSize = 4096;
+static const uint32_t ioSizeClassCount = 52; // up to 64MB, larger buffers aren't pooled
+static const uint32_t ioUnpooled = ~0u;
+
+static struct IOBufferPool {
+  hMutex                 access; // buffers can be released from free tasks
+  hstd::vector<uint8_t*> freeBuffers[ioSizeClassCount];
+  size_t                 idleBudget = 0; // in bytes, how much is kept in freeBuffers
+  size_t                 idleBytes = 0;
+  size_t                 liveBytes = 0;     // handed out
+  size_t                 residentBytes = 0; // handed out and kept by a loaded resource, see IOBuffer::markResident()
+  uint64_t               allocs = 0;
+  uint64_t               reuses = 0;
+} ioPool;
+
+// Page multiples up to 16KB then quarter steps between powers of two, so no more than 25% of a buffer goes unused
+static size_t ioSizeClass(size_t size, uint32_t* o_class) {
+  size_t pages = hutil::tmax<size_t>((size + ioPageSize - 1) / ioPageSize, 1);
+  if (pages <= 4) {
+    *o_class = (uint32_t)pages - 1;
+    return pages * ioPageSize;
+  }
+  uint32_t p = 2; // pages is in (2^p, 2^(p+1)]
+  while ((pages - 1) >> (p + 1))
+    ++p;
+  size_t   step = (size_t)1 << (p - 2);
+  size_t   steps = (pages + step - 1) / step; // 5 to 8
+  uint32_t size_class = 4 + (p - 2) * 4 + (uint32_t)(steps - 5);
+  *o_class = size_class < ioSizeClassCount ? size_class : ioUnpooled;
+  return steps * step * ioPageSize;
+}
+
+// Move only owner of a pooled buffer, or of a view of a copy in the shared cache (see mapSharedCopy())
+class IOBuffer {
+public:
+  IOBuffer() = default;
+  IOBuffer(IOBuffer&& rhs) { *this = std::move(rhs); }
+  IOBuffer(IOBuffer const&) = delete;
+  ~IOBuffer() { reset(); }
+
+  IOBuffer& operator=(IOBuffer&& rhs) {
+    if (this != &rhs) {
+      reset();
+      data = rhs.data;
+      capacity = rhs.capacity;
+      sizeClass = rhs.sizeClass;
+      resident = rhs.resident;
+      shared = rhs.shared;
+      rhs.data = nullptr;
+      rhs.shared = hfs::SharedMemory();
+    }
+    return *this;
+  }
+  IOBuffer& operator=(IOBuffer const&) = delete;
+
+  uint8_t* get() const { return data; }
+  explicit operator bool() const { return !!data; }
+
+  void alloc(size_t size) {
+    reset();
+    capacity = ioSizeClass(size, &sizeClass);
+    {
+      hScopedMutex sentry(&ioPool.access);
+      ioPool.liveBytes += capacity;
+      if (sizeClass != ioUnpooled && !ioPool.freeBuffers[sizeClass].empty()) {
+        data = ioPool.freeBuffers[sizeClass].back();
+        ioPool.freeBuffers[sizeClass].pop_back();
+        ioPool.idleBytes -= capacity;
+        ++ioPool.reuses;
+        return;
+      }
+      ++ioPool.allocs;
+    }
+    data = (uint8_t*)hcrt::alignedMalloc(capacity, ioPageSize);
+  }
+
+  // Read only, offset is where the file data starts in the view
+  void adoptShared(hfs::SharedMemory* shm, size_t offset) {
+    reset();
+    shared = *shm;
+    *shm = hfs::SharedMemory();
+    data = (uint8_t*)shared.data + offset;
+  }
+
+  void reset() {
+    if (!data) return;
+    if (shared.platform) {
+      hfs::closeSharedMemory(&shared);
+      data = nullptr;
+      return;
+    }
+    uint8_t* to_free = data;
+    {
+      hScopedMutex sentry(&ioPool.access);
+      ioPool.liveBytes -= capacity;
+      if (resident) ioPool.residentBytes -= capacity;
+      if (sizeClass != ioUnpooled && ioPool.idleBytes + capacity <= ioPool.idleBudget) {
+        ioPool.freeBuffers[sizeClass].push_back(data);
+        ioPool.idleBytes += capacity;
+        to_free = nullptr;
+      }
+    }
+    if (to_free) hcrt::alignedFree(to_free);
+    data = nullptr;
+    resident = false;
+  }
+
+  // Kept by a loaded resource (persistFileData) so no longer counts as in flight
+  void markResident() {
+    if (!data || resident || shared.platform) return;
+    hScopedMutex sentry(&ioPool.access);
+    ioPool.residentBytes += capacity;
+    resident = true;
+  }
+
+private:
+  uint8_t*          data = nullptr;
+  size_t            capacity = 0;
+  uint32_t          sizeClass = ioUnpooled;
+  bool              resident = false;
+  hfs::SharedMemory shared;
+};
+
+// Bytes in buffers waiting on a read or a deserialise
+static size_t ioBytesInFlight() {
+  hScopedMutex sentry(&ioPool.access);
+  return ioPool.liveBytes - ioPool.residentBytes;
+}
+
+static void freeIdleIOBuffers() {
+  hScopedMutex sentry(&ioPool.access);
+  for (auto& buffers : ioPool.freeBuffers) {
+    for (auto* b : buffers)
+      hcrt::alignedFree(b);
+    buffers.clear();
+  }
+  ioPool.idleBytes = 0;
+}
+
+// File contents read by one process are published to named shared memory, keyed by uuid and content hash, so other
+// processes on the machine map that copy instead of reading their own. The header is written last, see
+// publishSharedCopy().
+static const uint32_t sharedCacheMagic = HART_MAKE_FOURCC('h', 's', 'c', '1');
+static const size_t   sharedCacheHeaderSize = 64; // keeps the file data's alignment
+
+struct SharedCacheHeader {
+  hatomic::auint32_t ready; // set once the file data is written
+  uint32_t           magic;
+  uint64_t           size; // of the file data
+};
+
+struct SharedCopy {
+  uint32_t          slot;
+  hfs::SharedMemory shm;
+};
+
+enum class PrefetchState : uint8_t {
+  None,
+  Queued,  // in ctx.prefetchQueue
+  Reading, // read in flight into loadtimeData
+  Ready,   // loadtimeData holds the file, waiting on a load to deserialise it
+};
+
 struct Resource {
-  resid_t                   uuid;
-  uint32_t                  typecc = 0; // The four CC code
-  hfb::ResourceInfo const*  info = nullptr;
-  hstd::unique_ptr<uint8_t> loadtimeData;
-  void*                     runtimeData = nullptr; //
-  hatomic::aint32_t         refCount =
+  resid_t                     uuid;
+  uint32_t                    typecc = 0; // The four CC code
+  hfb::ResourceInfo const*    info = nullptr;
+  IOBuffer                    loadtimeData;
+  void*                       runtimeData = nullptr; //
+  hatomic::aint32_t           refCount =
     0; // Only valid when runtimeData is !nullptr (or resource system is loading runtime data. Need extra flag?)
+  // Odd while runtimeData is valid. Bumped after runtimeData is set and before it's cleared, so readers can check
+  // runtimeData & typecc without taking the lock. See resolveResource().
+  hatomic::aint32_t generation = 0;
+  // Zero ref resources stay resident in a per type LRU list until evicted. See cacheResource().
+  bool      cached = false;
+  Resource* lruPrev = nullptr; // towards most recently used
+  Resource* lruNext = nullptr; // towards least recently used
+  PrefetchState prefetch = PrefetchState::None;
+  uint32_t      prefetchReadyAt = 0; // ctx.prefetchUpdates when it became Ready
 #if HART_DEBUG_INFO
   HandleBase debugLoadHandle;
 #endif
 };
 
+// Unreferenced resources of a type are kept loaded until the type goes over its budget. Resident size is approximated
+// by the file size of the resource.
+struct TypeCache {
+  size_t    budget = 0; // in bytes
+  size_t    used = 0;   // in bytes
+  Resource* head = nullptr; // most recently used
+  Resource* tail = nullptr; // least recently used
+};
+
+// Destruction is split in two. destruct() may release GPU resources so it runs on the main thread, time sliced in
+// update(). Freeing the CPU side memory is then handed to a worker task, for types flagged ObjectFlag_ThreadSafeFree.
+struct PendingDestroy {
+  hobjfact::ObjectDefinition const* objDef;
+  void*                             runtimeData;
+  IOBuffer                          loadtimeData;
+};
+
+struct FreeBatch {
+  PendingDestroy* begin;
+  PendingDestroy* end;
+};
+
+static const size_t freeBatchSize = 64;
+
+// Log2 bucketed histogram. Bucket i holds samples in [2^(i-1), 2^i), bucket 0 holds zeros.
+struct Histogram {
+  uint64_t buckets[64] = {0};
+  uint64_t count = 0;
+  uint64_t total = 0;
+  uint64_t max = 0;
+
+  void add(uint64_t v) {
+    uint32_t b = 0;
+    while (b < 63 && (v >> b)) ++b;
+    ++buckets[b];
+    ++count;
+    total += v;
+    max = hutil::tmax(max, v);
+  }
+  // p in [0, 1]. Accurate to the bucket, returns the bucket's upper bound
+  uint64_t percentile(float p) const {
+    if (!count) return 0;
+    uint64_t target = hutil::tmin((uint64_t)(p * count), count - 1);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < 64; ++i) {
+      seen += buckets[i];
+      if (seen > target) return i ? hutil::tmin(((uint64_t)1 << i) - 1, max) : 0;
+    }
+    return max;
+  }
+  uint64_t mean() const { return count ? total / count : 0; }
+};
+
+// Per asset type load metrics. Times are in microseconds. Like the cache, resident bytes are approximated by file size.
+struct TypeMetrics {
+  Histogram queueWaitUS;   // from loadResource() to the resource's own load starting
+  Histogram ioUS;          // open + read
+  Histogram deserialiseUS; // deserialiseObject(), includes any GPU resource creation
+  Histogram finaliseUS;    // main thread time for the load outside of deserialise (open, issuing reads, publish)
+  Histogram bytesRead;     // per load
+  uint64_t  cacheHits = 0;
+  uint64_t  bytesResident = 0;
+  uint64_t  peakBytesResident = 0;
+  float     finaliseEstimateMS = 0.f; // moving average of deserialise + finalise, used to fit loads into loadBudgetMS
+};
+
+static const float finaliseEstimateWeight = .25f; // of the newest sample
+
+// Timings of the resource currently being loaded. Its type isn't known until it's deserialised.
+struct LoadMetrics {
+  htime::Timer ioTimer;
+  float        queueWaitMS = 0.f;
+  float        ioMS = 0.f;
+  float        deserialiseMS = 0.f;
+  float        mainThreadMS = 0.f;
+};
+
 struct LoadRequest {
   LoadRequest() = default;
-  LoadRequest(resid_t a, uint64_t c) : uuid(a), transaction(c) {}
-  resid_t  uuid;
+  LoadRequest(uint32_t a, uint64_t c) : slot(a), transaction(c) {}
+  uint32_t slot;
   uint64_t transaction = 0;
 };
 
+// All the resources requested by a single call to loadResource()
+struct LoadTransaction {
+  uint64_t               id = 0;
+  HandleBase*            hdl = nullptr;
+  LoadCallback           onLoaded;
+  hstd::vector<uint32_t> resources; // slots. prerequisites first, requested resource last
+  uint32_t               next = 0;  // resources before this index hold a reference
+  bool                   cancelled = false;
+  htime::Timer           queued;
+  hstd::vector<uint32_t> loadedFromDisk; // slots in the order they were read, for the load trace
+};
+
+typedef hstd::unique_ptr<LoadTransaction> LoadTransactionPtr;
+
 enum class ResourceLoadState {
   OpenFile,
   OpenFileWait,
   ReadFile,
   ReadFileWait,
+  PrefetchWait,
   LoadResource,
   LoadNext,
   Waiting,
   Unload,
 };
 
+// Posted to ctx.prefetchCompletions as the user data of its open, then of its read
+struct PrefetchRead {
+  uint32_t        slot;
+  hfs::FileHandle file;
+  bool            opened; // the read has been issued
+};
+
+// One read of a bundle file, posted to ctx.bundleCompletions like a PrefetchRead. Each member claimed by the read is
+// marked PrefetchState::Reading until it completes.
+struct BundleRead {
+  hfb::ResourceBundle const*  bundle;
+  hfs::FileHandle             file = nullptr;
+  bool                        opened = false;
+  IOBuffer                    data;
+  hstd::vector<uint32_t>      members; // positions in bundle->members() claimed by this read
+};
+
+typedef hstd::unique_ptr<BundleRead> BundleReadPtr;
+
+struct ReadyPrefetch {
+  uint32_t slot;
+  uint32_t readyAt; // ctx.prefetchUpdates
+};
+
+// Load trace file layout: TraceFileHeader then, per trace, the root uuid, a uint32_t count and count uuids.
+struct TraceFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t traceCount;
+};
+
+static const uint32_t traceFileMagic = HART_MAKE_FOURCC('l', 't', 'r', 'c');
+static const uint32_t traceFileVersion = 1;
+
+#if HART_DEBUG_INFO
+// A changed file can still be open in the tool writing it, so failed reads are retried for a while
+struct PendingReload {
+  uint32_t slot;
+  uint32_t attempts;
+};
+
+static const uint32_t maxReloadAttempts = 60;
+
+struct ReloadFile {
+  IOBuffer data;
+  uint64_t size;
+};
+#endif
+
+// Resource slots are allocated a page at a time, the first time any slot in the page is used
+static const uint32_t resourcePageShift = 8;
+static const uint32_t resourcePageSize = 1 << resourcePageShift;
+
+struct ResourcePage {
+  Resource resources[resourcePageSize];
+};
+
 static struct LoadedResourceContext {
-  hMutex                    access;
-  hstd::unique_ptr<uint8_t> resourcedb;
-  hfb::ResourceList const*  resourceListings;
-  hstd::unordered_map<resid_t, Resource> resources;
-  hstd::vector<LoadRequest> loadQueue;
+  hMutex                   access;
+  hfs::MappedView          resourcedb;
+  hfb::ResourceList const* resourceListings;
+  // One slot per resource in the DB, in DB order, so prerequisite indices are slot indices. Pages are published
+  // atomically and never freed until shutdown, so slots are safe to read without the lock.
+  hstd::unique_ptr<hatomic::aptr_t<ResourcePage>[]> resourcePages;
+  uint32_t                                          resourceCount = 0;
+  // Only used by resource DBs with unsorted uuids, otherwise uuids are binary searched in the DB
+  hstd::unordered_map<resid_t, uint32_t> resourceIndex;
+  hstd::vector<LoadTransactionPtr> loadQueues[(uint32_t)LoadPriority::Count];
+  LoadTransaction*                 activeLoad = nullptr; // the transaction the state machine is working through
+  hstd::vector<LoadTransactionPtr> completedLoads;       // waiting on their callback
   hstd::vector<LoadRequest> unloadQueue;
   uint64_t                  transactions = 0;
   ResourceLoadState         resState = ResourceLoadState::Waiting;
   hfs::FileHandle           fileHdl;
   hfs::FileOpHandle         fileOp;
   engine::DebugMenuHandle   dbmenuHdl;
-  time_t                    resourcedbMTime;
+  size_t                    defaultCacheBudget = 0;
+  hstd::unordered_map<uint32_t, TypeCache> typeCaches;
+  float                        unloadBudgetMS = 1.f;
+  float                        loadBudgetMS = 2.f; // main thread time per update() for loading
+  uint64_t                     deferredFinalises = 0;
+  hstd::vector<PendingDestroy> destroyQueue;  // waiting on destruct(), oldest first
+  hstd::vector<PendingDestroy> pendingFrees;  // destructed, waiting on the next free task
+  hstd::vector<PendingDestroy> inFlightFrees; // owned by freeGraph while freeKicked is set
+  hstd::vector<FreeBatch>      freeBatches;
+  htasks::Graph                freeGraph;
+  htasks::TaskHandle           freeTask;
+  bool                         freeKicked = false;
+  hstd::unordered_map<uint32_t, TypeMetrics> metrics;
+  LoadMetrics                                loadMetrics;
+  engine::DebugMenuHandle                    dbmetricsHdl;
+  // Load traces, keyed by the uuid of the resource that was requested
+  bool                                                 loadTraces = false;
+  hstd::vector<uint32_t>                               traceTypes;
+  hstd::unordered_map<resid_t, hstd::vector<resid_t>> traces;
+  hstd::vector<uint32_t>                               prefetchQueue; // slots, in trace order
+  hfs::CompletionQueueHandle                           prefetchCompletions = nullptr;
+  uint32_t                                             prefetchReads = 0; // posted to prefetchCompletions
+  uint32_t                                             maxPrefetchReads = 32;
+  bool                                                 tracesDirty = false; // written at shutdown()
+  // Prefetches that became Ready, oldest first. See expireReadyPrefetches().
+  hstd::vector<ReadyPrefetch>                          readyPrefetches;
+  uint32_t                                             prefetchUpdates = 0;
+  uint32_t                                             prefetchExpiry = 600; // updates
+  size_t                                               maxInFlightBytes = 0; // caps reads ahead of a load
+  size_t                                               directIOMinSize = 0;  // 0 reads everything through the cache
+  uint32_t                                             ioSlot = invalidSlot; // being read by the state machine
+  hfs::CompletionQueueHandle                           bundleCompletions = nullptr;
+  uint32_t                                             bundleReads = 0; // posted to bundleCompletions
+  hstd::vector<PrerequisiteData>                       prerequisiteData; // backs ResourceLoadData::prerequisites
+  // Shared cache, see mapSharedCopy()
+  bool                     sharedCache = false;
+  hstd::string             sharedCachePrefix;
+  size_t                   sharedCacheMinSize = 0;
+  size_t                   sharedCacheBudget = 0; // in bytes, how much this process publishes
+  size_t                   sharedPublishedBytes = 0;
+  hstd::vector<SharedCopy> sharedPublished; // kept open until shutdown, Windows frees them with the last view
+  uint64_t                 sharedHits = 0;
+#if HART_DEBUG_INFO
+  // Hot reload, see updateHotReload()
+  hfs::WatchHandle                            watch = nullptr;
+  hstd::string                                watchRoot; // with a trailing '/'
+  hstd::unordered_map<hstd::string, uint32_t> slotsByPath;
+  hstd::vector<hstd::vector<uint32_t>>        dependents; // by slot, the reverse of prerequisites
+  hstd::vector<PendingReload>                 reloadQueue;
+#endif
 } ctx;
 
 static const char* resourceDBPath = "/data/resourcedb.bin";
+static const char* metricsDumpPath = "/resource_metrics.json";
+static const char* loadTracePath = "/loadtraces.bin";
 
-bool initialise() {
-  hfs::FileHandle   res_file;
-  hfs::FileOpHandle op_hdl = hfs::openFile(resourceDBPath, hfs::Mode::Read, &res_file);
-  if (hfs::fileOpWait(op_hdl) != hfs::Error::Ok) return false;
+// Compares in the order the builder sorts the DB by
+static int32_t compareUUID(resid_t const& lhs, resource::uuid const& rhs) {
+  uint32_t const rhs_words[4] = {rhs.lowword(), rhs.highword1(), rhs.highword2(), rhs.highword3()};
+  for (int32_t i = 3; i >= 0; --i) {
+    if (lhs.words[i] != rhs_words[i]) return lhs.words[i] < rhs_words[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+static uint32_t findAssetIndex(resid_t res_id) {
+  if (!ctx.resourceListings->sortedUUIDs()) {
+    auto found = ctx.resourceIndex.find(res_id);
+    return found != ctx.resourceIndex.end() ? found->second : invalidSlot;
+  }
 
-  hfs::FileStat stat;
-  op_hdl = hfs::fstatAsync(res_file, &stat);
-  if (hfs::fileOpWait(op_hdl) != hfs::Error::Ok) return false;
+  auto const* asset_uuids = ctx.resourceListings->assetUUIDs();
+  uint32_t    lo = 0, hi = asset_uuids->size();
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    int32_t  cmp = compareUUID(res_id, *(*asset_uuids)[mid]);
+    if (cmp == 0) return mid;
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return invalidSlot;
+}
 
-  ctx.resourcedbMTime = stat.modifiedDate;
-  ctx.resourcedb.reset(new uint8_t[stat.filesize]);
-  op_hdl = hfs::freadAsync(res_file, ctx.resourcedb.get(), stat.filesize, 0);
-  if (hfs::fileOpWait(op_hdl) != hfs::Error::Ok) return false;
+// An asset with the same contents as another is loaded through the other's slot, so they share one copy
+static uint32_t findSlot(resid_t res_id) {
+  uint32_t index = findAssetIndex(res_id);
+  if (index == invalidSlot) return invalidSlot;
+  int32_t alias_of = (*ctx.resourceListings->assetInfos())[index]->aliasOf();
+  return alias_of >= 0 ? (uint32_t)alias_of : index;
+}
+
+// Must hold ctx.access. Creates the slot's page on first use.
+static Resource& getResource(uint32_t slot) {
+  auto&         page_ptr = ctx.resourcePages[slot >> resourcePageShift];
+  ResourcePage* page = hatomic::atomicGet(page_ptr);
+  if (!page) {
+    auto const* asset_uuids = ctx.resourceListings->assetUUIDs();
+    auto const* asset_infos = ctx.resourceListings->assetInfos();
+    uint32_t    first = slot & ~(resourcePageSize - 1);
+    page = new ResourcePage();
+    for (uint32_t i = 0, n = hutil::tmin(resourcePageSize, ctx.resourceCount - first); i < n; ++i) {
+      page->resources[i].uuid = huuid::fromData(*(*asset_uuids)[first + i]);
+      page->resources[i].info = (*asset_infos)[first + i];
+    }
+    hatomic::atomicSet(page_ptr, page);
+  }
+  return page->resources[slot & (resourcePageSize - 1)];
+}
 
-  ctx.resourceListings = hfb::GetResourceList(ctx.resourcedb.get());
+// Lock free. nullptr if nothing in the slot's page has been used yet
+static Resource const* peekResource(uint32_t slot) {
+  ResourcePage* page = hatomic::atomicGet(ctx.resourcePages[slot >> resourcePageShift]);
+  return page ? &page->resources[slot & (resourcePageSize - 1)] : nullptr;
+}
 
-  // Alloc space for all handles upfront
-  auto const* asset_uuids = ctx.resourceListings->assetUUIDs();
+// Prerequisites are loaded before anything that depends on them, so their data is ready to hand to deserialise
+static void initLoadData(Resource const& res, ResourceLoadData* load_data) {
+  auto const* prerequisites = res.info->prerequisites();
+  ctx.prerequisiteData.resize(prerequisites->size());
+  for (uint32_t i = 0, n = prerequisites->size(); i < n; ++i) {
+    Resource const&   p = getResource((*prerequisites)[i]);
+    PrerequisiteData& pd = ctx.prerequisiteData[i];
+    pd.id = p.uuid;
+    pd.data = p.runtimeData;
+    pd.typecc = p.typecc;
+  }
+  load_data->friendlyName = res.info->friendlyName()->c_str();
+  load_data->prerequisites = ctx.prerequisiteData.data();
+  load_data->prerequisiteCount = (uint32_t)ctx.prerequisiteData.size();
+}
+
+bool dumpMetrics(const char* path);
+
+static void freeResourceBatch(htasks::Info* info) {
+  FreeBatch const* batch = (FreeBatch const*)info->taskInput;
+  for (PendingDestroy* i = batch->begin; i != batch->end; ++i) {
+    i->objDef->objFree(i->runtimeData);
+    i->loadtimeData.reset();
+  }
+}
+
+static void readLoadTraces() {
+  hfs::FileHandle file;
+  if (hfs::fileOpWait(hfs::openFile(loadTracePath, hfs::Mode::Read, &file)) != hfs::Error::Ok) return;
+
+  hfs::FileStat               stat;
+  hstd::unique_ptr<uint8_t[]> data;
+  bool                        ok = hfs::fileOpWait(hfs::fstatAsync(file, &stat)) == hfs::Error::Ok;
+  if (ok) {
+    data.reset(new uint8_t[stat.filesize]);
+    ok = hfs::fileOpWait(hfs::freadAsync(file, data.get(), stat.filesize, 0)) == hfs::Error::Ok;
+  }
+  hfs::closeFile(file);
+  if (!ok || stat.filesize < sizeof(TraceFileHeader)) return;
+
+  TraceFileHeader header;
+  uint8_t const*  ptr = data.get();
+  uint8_t const*  end = ptr + stat.filesize;
+  hcrt::memcpy(&header, ptr, sizeof(header));
+  ptr += sizeof(header);
+  if (header.magic != traceFileMagic || header.version != traceFileVersion) return;
+
+  for (uint32_t i = 0; i < header.traceCount; ++i) {
+    resid_t  root;
+    uint32_t count;
+    if (end - ptr < (ptrdiff_t)(sizeof(root) + sizeof(count))) break;
+    hcrt::memcpy(&root, ptr, sizeof(root));
+    hcrt::memcpy(&count, ptr + sizeof(root), sizeof(count));
+    ptr += sizeof(root) + sizeof(count);
+    if ((size_t)(end - ptr) < count * sizeof(resid_t)) break;
+    auto& trace = ctx.traces[root];
+    trace.resize(count);
+    hcrt::memcpy(trace.data(), ptr, count * sizeof(resid_t));
+    ptr += count * sizeof(resid_t);
+  }
+}
+
+// Once, from shutdown(), so recording a trace never waits on the disk
+static void writeLoadTraces() {
+  TraceFileHeader header;
+  header.magic = traceFileMagic;
+  header.version = traceFileVersion;
+  header.traceCount = (uint32_t)ctx.traces.size();
+  hstd::vector<uint8_t> data((uint8_t const*)&header, (uint8_t const*)(&header + 1));
+  for (auto const& i : ctx.traces) {
+    uint32_t count = (uint32_t)i.second.size();
+    data.insert(data.end(), (uint8_t const*)&i.first, (uint8_t const*)(&i.first + 1));
+    data.insert(data.end(), (uint8_t const*)&count, (uint8_t const*)(&count + 1));
+    data.insert(data.end(), (uint8_t const*)i.second.data(), (uint8_t const*)(i.second.data() + count));
+  }
+
+  hfs::FileHandle file;
+  if (hfs::fileOpWait(hfs::openFile(loadTracePath, hfs::Mode::Write, &file)) != hfs::Error::Ok) return;
+  hfs::fileOpWait(hfs::fwriteAsync(file, data.data(), data.size(), 0));
+  hfs::closeFile(file);
+}
+
+#if HART_DEBUG_INFO
+// Changed files under [resourcemanager] hotreloaddir are deserialised again in place at the start of update(), along
+// with any loaded dependents that keep pointers into them. Changes to the resource DB itself need a restart.
+static void initHotReload() {
+  const char* dir = hconfigopt::getStr("resourcemanager", "hotreloaddir", "/data");
+  ctx.watch = hfs::watchDirectory(dir);
+  if (!ctx.watch) return;
+
+  ctx.watchRoot = dir;
+  if (ctx.watchRoot.empty() || ctx.watchRoot.back() != '/') ctx.watchRoot += '/';
   auto const* asset_infos = ctx.resourceListings->assetInfos();
-  for (uint32_t i = 0, n = asset_uuids->size(); i < n; ++i) {
-    resid_t id;
-    id.words[3] = (*asset_uuids)[i]->highword3();
-    id.words[2] = (*asset_uuids)[i]->highword2();
-    id.words[1] = (*asset_uuids)[i]->highword1();
-    id.words[0] = (*asset_uuids)[i]->lowword();
-    Resource& res = ctx.resources[id];
-    res.uuid = id;
-    res.info = (*asset_infos)[i];
+  ctx.slotsByPath.reserve(ctx.resourceCount);
+  ctx.dependents.resize(ctx.resourceCount);
+  for (uint32_t i = 0; i < ctx.resourceCount; ++i) {
+    auto const* info = (*asset_infos)[i];
+    // Aliases share their file with the asset that's loaded in their place
+    if (info->aliasOf() >= 0) continue;
+    auto const* prerequisites = info->prerequisites();
+    ctx.slotsByPath[info->filepath()->c_str()] = i;
+    for (uint32_t p = 0, n = prerequisites->size(); p < n; ++p) {
+      ctx.dependents[(*prerequisites)[p]].push_back(i);
+    }
+  }
+}
+
+// Depth first over loaded dependents that need deserialising again. Appends in post order.
+static void gatherReloads(uint32_t slot, hstd::unordered_set<uint32_t>* visited, hstd::vector<uint32_t>* o_order) {
+  if (!visited->insert(slot).second) return;
+  for (auto d : ctx.dependents[slot]) {
+    Resource const& dep = getResource(d);
+    if (!dep.runtimeData ||
+        (hobjfact::getObjectDefinition(dep.typecc)->flags & hobjfact::ObjectFlag_NoPrerequisitePointers))
+      continue;
+    gatherReloads(d, visited, o_order);
+  }
+  o_order->push_back(slot);
+}
+
+// The file size in the DB is stale once the file has changed, so it's read by size on disk
+static bool readReloadFile(Resource const& res, IOBuffer* o_data, uint64_t* o_size) {
+  hfs::FileHandle file;
+  if (hfs::fileOpWait(hfs::openFile(res.info->filepath()->c_str(), hfs::Mode::Read, &file)) != hfs::Error::Ok)
+    return false;
+
+  hfs::FileStat stat = {};
+  bool ok = hfs::fileOpWait(hfs::fstatAsync(file, &stat)) == hfs::Error::Ok && stat.filesize > sizeof(uint32_t) * 2;
+  if (ok) {
+    o_data->alloc(stat.filesize);
+    ok = hfs::fileOpWait(hfs::freadAsync(file, o_data->get(), stat.filesize, 0)) == hfs::Error::Ok;
+  }
+  hfs::closeFile(file);
+  if (ok) *o_size = stat.filesize;
+  return ok;
+}
+
+// Deserialise the file again and swap it in. Handles see the new data once they notice the generation has changed.
+// The old data goes through the destroy queue like an unload.
+static void reloadResource(Resource& res, IOBuffer data, uint64_t size) {
+  ResourceLoadData          load_data;
+  hobjfact::SerialiseParams ser_params;
+  uint32_t                  typecc = 0;
+  initLoadData(res, &load_data);
+  ser_params.resdata = &load_data;
+  void* runtime_data = hobjfact::deserialiseObject(data.get(), size, &ser_params, &typecc);
+  if (!runtime_data) return;
+
+  PendingDestroy pd;
+  if (typecc != res.typecc) {
+    // The type's cache & metrics have already accounted for it, so it can't change type in place
+    hdbprintf("Can't hot reload %s, its type has changed\n", load_data.friendlyName);
+    pd.objDef = hobjfact::getObjectDefinition(typecc);
+    pd.runtimeData = runtime_data;
+    if (load_data.persistFileData) pd.loadtimeData = std::move(data);
+    ctx.destroyQueue.push_back(std::move(pd));
+    return;
+  }
+  pd.objDef = hobjfact::getObjectDefinition(res.typecc);
+  pd.runtimeData = res.runtimeData;
+  pd.loadtimeData = std::move(res.loadtimeData);
+  ctx.destroyQueue.push_back(std::move(pd));
+  if (load_data.persistFileData) {
+    data.markResident();
+    res.loadtimeData = std::move(data);
+  }
+  hatomic::increment(res.generation); // even, readers back off until the swap is done
+  res.runtimeData = runtime_data;
+  hatomic::increment(res.generation);
+}
+
+static void updateHotReload() {
+  if (!ctx.watch) return;
+
+  hfs::DirEntry changed;
+  while (hfs::readWatch(ctx.watch, &changed)) {
+    auto found = ctx.slotsByPath.find(ctx.watchRoot + changed.filename);
+    if (found == ctx.slotsByPath.end()) continue;
+    bool queued = false;
+    for (auto const& r : ctx.reloadQueue) {
+      queued |= r.slot == found->second;
+    }
+    if (!queued) ctx.reloadQueue.push_back({found->second, 0});
+  }
+  if (ctx.reloadQueue.empty()) return;
+
+  // Read every changed file first, so one that can't be read yet doesn't reload its dependents for nothing
+  htime::Timer                              timer;
+  hstd::unordered_map<uint32_t, ReloadFile> files;
+  hstd::vector<PendingReload>               retry;
+  for (auto& r : ctx.reloadQueue) {
+    Resource& res = getResource(r.slot);
+    if (res.prefetch == PrefetchState::Ready) {
+      // Read before the change
+      res.prefetch = PrefetchState::None;
+      res.loadtimeData.reset();
+    }
+    // Nothing to do if it isn't loaded, the next load reads the new file
+    if (!res.runtimeData) continue;
+    ReloadFile& rf = files[r.slot];
+    if (!readReloadFile(res, &rf.data, &rf.size)) {
+      files.erase(r.slot);
+      if (++r.attempts < maxReloadAttempts) retry.push_back(r);
+    }
+  }
+  ctx.reloadQueue.swap(retry);
+  if (files.empty()) return;
+
+  // Reversed post order puts everything after the resources it points into, changed or not
+  hstd::unordered_set<uint32_t> visited;
+  hstd::vector<uint32_t>        order;
+  for (auto const& i : files) {
+    gatherReloads(i.first, &visited, &order);
+  }
+  std::reverse(order.begin(), order.end());
+  for (auto slot : order) {
+    Resource& res = getResource(slot);
+    auto      found = files.find(slot);
+    if (found != files.end()) {
+      reloadResource(res, std::move(found->second.data), found->second.size);
+      continue;
+    }
+    ReloadFile rf;
+    if (readReloadFile(res, &rf.data, &rf.size)) {
+      reloadResource(res, std::move(rf.data), rf.size);
+    } else {
+      hdbprintf("Failed to reload %s after its prerequisite changed\n", res.info->friendlyName()->c_str());
+    }
   }
+  hdbprintf("Hot reloaded %zu changed resource(s) and %zu dependent(s) in %.2f ms\n", files.size(),
+            order.size() - files.size(), timer.elapsedMS());
+}
+#endif
+
+bool initialise() {
+  // The DB is queried in place. Only pages touched by the OS end up resident, unless it's prefaulted to keep lookups
+  // from ever waiting on the disk
+  hfs::MapRange db_range;
+  db_range.prefault = hconfigopt::getBool("resourcemanager", "prefaultdb", false);
+  if (!hfs::mapFile(resourceDBPath, db_range, &ctx.resourcedb)) return false;
+  ctx.resourceListings = hfb::GetResourceList(ctx.resourcedb.data);
 
-  hfs::closeFile(res_file);
+  auto const* asset_uuids = ctx.resourceListings->assetUUIDs();
+  ctx.resourceCount = asset_uuids->size();
+  ctx.resourcePages.reset(new hatomic::aptr_t<ResourcePage>[(ctx.resourceCount >> resourcePageShift) + 1]());
+  if (!ctx.resourceListings->sortedUUIDs()) {
+    // Older DB, fall back to indexing it upfront
+    ctx.resourceIndex.reserve(ctx.resourceCount);
+    for (uint32_t i = 0, n = ctx.resourceCount; i < n; ++i) {
+      ctx.resourceIndex[huuid::fromData(*(*asset_uuids)[i])] = i;
+    }
+  }
+
+  ctx.defaultCacheBudget = (size_t)hconfigopt::getUint("resourcemanager", "cachebudgetkb", 0) * 1024;
+  ctx.unloadBudgetMS = hconfigopt::getFloat("resourcemanager", "unloadbudgetms", 1.f);
+  ctx.loadBudgetMS = hconfigopt::getFloat("resourcemanager", "loadbudgetms", 2.f);
+  ctx.freeTask = ctx.freeGraph.addTask("hresmgr::free", freeResourceBatch);
+  ctx.loadTraces = hconfigopt::getBool("resourcemanager", "loadtraces", false);
+  ctx.maxPrefetchReads = hconfigopt::getUint("resourcemanager", "maxprefetchreads", 32);
+  ctx.prefetchExpiry = hconfigopt::getUint("resourcemanager", "prefetchexpiryupdates", 600);
+  ctx.prefetchCompletions = hfs::createCompletionQueue();
+  ctx.bundleCompletions = hfs::createCompletionQueue();
+  ctx.maxInFlightBytes = (size_t)hconfigopt::getUint("resourcemanager", "ioinflightkb", 64 * 1024) * 1024;
+  ctx.directIOMinSize = (size_t)hconfigopt::getUint("resourcemanager", "directiominkb", 0) * 1024;
+  ioPool.idleBudget = (size_t)hconfigopt::getUint("resourcemanager", "iopoolkb", 16 * 1024) * 1024;
+  ctx.sharedCache = hconfigopt::getBool("resourcemanager", "sharedcache", false);
+  ctx.sharedCachePrefix = hconfigopt::getStr("resourcemanager", "sharedcacheprefix", "hart");
+  ctx.sharedCacheMinSize = (size_t)hconfigopt::getUint("resourcemanager", "sharedcacheminkb", 16) * 1024;
+  ctx.sharedCacheBudget = (size_t)hconfigopt::getUint("resourcemanager", "sharedcachemb", 256) * 1024 * 1024;
+  // A list of four CCs, e.g. "rsct lvl_"
+  for (char const* types = hconfigopt::getStr("resourcemanager", "tracetypes", ""); *types;) {
+    if (hcrt::isspace(*types) || *types == ',') {
+      ++types;
+      continue;
+    }
+    char typecc[4] = {0};
+    for (uint32_t i = 0; i < 4 && *types && !hcrt::isspace(*types) && *types != ','; ++i)
+      typecc[i] = *types++;
+    while (*types && !hcrt::isspace(*types) && *types != ',')
+      ++types;
+    ctx.traceTypes.push_back(*(uint32_t*)typecc);
+  }
+  if (ctx.loadTraces) readLoadTraces();
 #if HART_DEBUG_INFO
+  if (hconfigopt::getBool("resourcemanager", "hotreload", false)) initHotReload();
+  // Edited files no longer match the DB's content hashes
+  if (ctx.watch) ctx.sharedCache = false;
   ctx.dbmenuHdl = engine::addDebugMenu("Resource Manager", []() {
     hScopedMutex sentry(&ctx.access);
     if (ImGui::Begin("Resource Manager", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_MenuBar)) {
-      static resid_t to_load;
-      auto const*    asset_uuids = ctx.resourceListings->assetUUIDs();
-      bool           loadResource = false;
-      if (!huuid::isNull(to_load) && !ctx.resources[to_load].debugLoadHandle.valid()) {
+      static uint32_t to_load = invalidSlot;
+      bool            loadResource = false;
+      if (to_load != invalidSlot && !getResource(to_load).debugLoadHandle.valid()) {
         if (ImGui::Button("Test Load Resource")) {
-          hresmgr::loadResource(to_load, &ctx.resources[to_load].debugLoadHandle);
+          hresmgr::loadResource(getResource(to_load).uuid, &getResource(to_load).debugLoadHandle);
         }
       }
-      if (!huuid::isNull(to_load) && ctx.resources[to_load].debugLoadHandle.valid() &&
-          ctx.resources[to_load].debugLoadHandle.loaded()) {
+      if (to_load != invalidSlot && getResource(to_load).debugLoadHandle.valid() &&
+          getResource(to_load).debugLoadHandle.loaded()) {
         if (ImGui::Button("Test Unload Resource")) {
         }
       }
@@ -127,13 +831,13 @@ bool initialise() {
       ImGui::Separator();
       static int32_t selected = -1;
       int32_t        index = 0;
-      for (const auto& i : ctx.resources) {
-        Resource const& r = i.second;
+      for (uint32_t slot = 0; slot < ctx.resourceCount; ++slot) {
+        Resource const& r = getResource(slot);
         char            txt_buf[256];
         if (ImGui::Selectable(r.info->friendlyName()->c_str(), selected == index,
                               ImGuiSelectableFlags_SpanAllColumns)) {
           selected = index;
-          to_load = r.uuid;
+          to_load = slot;
         }
         if (ImGui::IsItemHovered()) {
           auto const* prerequisites = r.info->prerequisites();
@@ -141,9 +845,7 @@ bool initialise() {
             ImGui::BeginTooltip();
             ImGui::Text("Depends on asset(s):");
             for (uint32_t i = 0, n = prerequisites->size(); i < n; ++i) {
-              uint32_t ridx = (*prerequisites)[i];
-              resid_t  p = huuid::fromData(*(*asset_uuids)[ridx]);
-              ImGui::Text("%s", ctx.resources[p].info->friendlyName()->c_str());
+              ImGui::Text("%s", getResource((*prerequisites)[i]).info->friendlyName()->c_str());
             }
             ImGui::EndTooltip();
           }
@@ -161,29 +863,627 @@ bool initialise() {
           ImGui::Text("Unknown until loaded once");
           ImGui::NextColumn();
         }
-        ImGui::Text("%d", hatomic::atomicGet(r.refCount));
+        if (r.cached) {
+          ImGui::Text("0 (cached)");
+        } else {
+          ImGui::Text("%d", hatomic::atomicGet(r.refCount));
+        }
         ImGui::NextColumn();
         ++index;
       }
     }
     ImGui::End();
   });
+  ctx.dbmetricsHdl = engine::addDebugMenu("Resource Metrics", []() {
+    bool dump = false;
+    {
+      hScopedMutex sentry(&ctx.access);
+      if (ImGui::Begin("Resource Metrics", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_MenuBar)) {
+        dump = ImGui::Button("Dump JSON");
+        ImGui::SameLine();
+        ImGui::Text("%s", metricsDumpPath);
+        ImGui::Separator();
+        ImGui::Text("Load budget %.1f ms per update, %llu finalises put off to the next update", ctx.loadBudgetMS,
+                    (unsigned long long)ctx.deferredFinalises);
+        if (ctx.sharedCache) {
+          ImGui::Text("Shared cache: %llu hits, %zu published (%zu KB)", (unsigned long long)ctx.sharedHits,
+                      ctx.sharedPublished.size(), ctx.sharedPublishedBytes / 1024);
+        }
+        ImGui::Text("Times are p50 / p95 in ms");
+        ImGui::Columns(8, "metrics");
+        ImGui::Text("TypeCC");
+        ImGui::NextColumn();
+        ImGui::Text("Loads (Hits)");
+        ImGui::NextColumn();
+        ImGui::Text("Queue Wait");
+        ImGui::NextColumn();
+        ImGui::Text("I/O");
+        ImGui::NextColumn();
+        ImGui::Text("Deserialise");
+        ImGui::NextColumn();
+        ImGui::Text("Main Thread");
+        ImGui::NextColumn();
+        ImGui::Text("Read KB");
+        ImGui::NextColumn();
+        ImGui::Text("Resident KB");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (auto const& i : ctx.metrics) {
+          TypeMetrics const& m = i.second;
+          char               txt_buf[5];
+          (*(uint32_t*)txt_buf) = i.first;
+          txt_buf[4] = 0;
+          ImGui::Text(txt_buf);
+          ImGui::NextColumn();
+          ImGui::Text("%llu (%llu)", (unsigned long long)m.bytesRead.count, (unsigned long long)m.cacheHits);
+          ImGui::NextColumn();
+          for (Histogram const* h : {&m.queueWaitUS, &m.ioUS, &m.deserialiseUS, &m.finaliseUS}) {
+            ImGui::Text("%.2f / %.2f", h->percentile(.5f) / 1000.f, h->percentile(.95f) / 1000.f);
+            ImGui::NextColumn();
+          }
+          ImGui::Text("%llu", (unsigned long long)(m.bytesRead.total / 1024));
+          ImGui::NextColumn();
+          ImGui::Text("%llu (peak %llu)", (unsigned long long)(m.bytesResident / 1024),
+                      (unsigned long long)(m.peakBytesResident / 1024));
+          ImGui::NextColumn();
+        }
+      }
+      ImGui::End();
+    }
+    if (dump) dumpMetrics(metricsDumpPath);
+  });
 #endif
   return true;
 }
 
-void update() {
+static void recordLoadMetrics(Resource const& res) {
+  TypeMetrics&       m = ctx.metrics[res.typecc];
+  LoadMetrics const& lm = ctx.loadMetrics;
+  m.queueWaitUS.add((uint64_t)(lm.queueWaitMS * 1000.f));
+  m.ioUS.add((uint64_t)(lm.ioMS * 1000.f));
+  m.deserialiseUS.add((uint64_t)(lm.deserialiseMS * 1000.f));
+  m.finaliseUS.add((uint64_t)(hutil::tmax(lm.mainThreadMS, 0.f) * 1000.f));
+  float cost_ms = lm.deserialiseMS + hutil::tmax(lm.mainThreadMS, 0.f);
+  m.finaliseEstimateMS = m.finaliseUS.count == 1
+                           ? cost_ms
+                           : m.finaliseEstimateMS + (cost_ms - m.finaliseEstimateMS) * finaliseEstimateWeight;
+  m.bytesRead.add(res.info->filesize());
+  m.bytesResident += res.info->filesize();
+  m.peakBytesResident = hutil::tmax(m.peakBytesResident, m.bytesResident);
+}
+
+// The resource is unloaded as far as the rest of the system is concerned once this returns, so it's free to be
+// loaded again while the old data is still waiting to be destroyed.
+static void destroyResource(Resource& res) {
+  if (res.runtimeData) {
+    PendingDestroy pd;
+    pd.objDef = hobjfact::getObjectDefinition(res.typecc);
+    pd.runtimeData = res.runtimeData;
+    pd.loadtimeData = std::move(res.loadtimeData);
+    ctx.destroyQueue.push_back(std::move(pd));
+  } else {
+    // Deserialising failed, there's only the file data to drop
+    res.loadtimeData.reset();
+  }
+  ctx.metrics[res.typecc].bytesResident -= res.info->filesize();
+  hatomic::increment(res.generation);
+  res.runtimeData = nullptr;
+}
+
+static void processDestroyQueue(float budget_ms) {
+  if (ctx.destroyQueue.empty()) return;
+
+  // Always destroy at least one resource a frame so the queue can't stall
+  htime::Timer timer;
+  size_t       done = 0;
+  for (size_t n = ctx.destroyQueue.size(); done < n;) {
+    PendingDestroy& pd = ctx.destroyQueue[done++];
+    pd.objDef->destruct(pd.runtimeData);
+    if (pd.objDef->flags & hobjfact::ObjectFlag_ThreadSafeFree) {
+      ctx.pendingFrees.push_back(std::move(pd));
+    } else {
+      pd.objDef->objFree(pd.runtimeData);
+      pd.loadtimeData.reset();
+    }
+    if (timer.elapsedMS() >= budget_ms) break;
+  }
+  ctx.destroyQueue.erase(ctx.destroyQueue.begin(), ctx.destroyQueue.begin() + done);
+}
+
+static void kickFreeTasks(bool block) {
+  if (ctx.freeKicked) {
+    if (!block && !ctx.freeGraph.isComplete()) return;
+    ctx.freeGraph.wait(); // consumes the completion signal
+    ctx.freeKicked = false;
+    ctx.inFlightFrees.clear();
+    ctx.freeBatches.clear();
+  }
+  if (ctx.pendingFrees.empty()) return;
+
+  ctx.inFlightFrees.swap(ctx.pendingFrees);
+  for (size_t i = 0, n = ctx.inFlightFrees.size(); i < n; i += freeBatchSize) {
+    FreeBatch batch;
+    batch.begin = ctx.inFlightFrees.data() + i;
+    batch.end = batch.begin + hutil::tmin(freeBatchSize, n - i);
+    ctx.freeBatches.push_back(batch);
+  }
+  ctx.freeGraph.clearTaskInputs(ctx.freeTask);
+  for (auto& batch : ctx.freeBatches)
+    ctx.freeGraph.addTaskInput(ctx.freeTask, &batch);
+  ctx.freeGraph.kick();
+  ctx.freeKicked = true;
+}
+
+static TypeCache& getTypeCache(uint32_t typecc) {
+  auto found = ctx.typeCaches.find(typecc);
+  if (found != ctx.typeCaches.end()) return found->second;
+
+  // Per type budgets live in the [resourcecache] section, in KB, keyed by four CC (e.g. tset=4096)
+  char key[5];
+  *((uint32_t*)key) = typecc;
+  key[4] = 0;
+  TypeCache& tc = ctx.typeCaches[typecc];
+  tc.budget = (size_t)hconfigopt::getUint("resourcecache", key, (uint32_t)(ctx.defaultCacheBudget / 1024)) * 1024;
+  return tc;
+}
+
+static void acquirePrerequisites(Resource const& res) {
+  auto const* prerequisites = res.info->prerequisites();
+  for (uint32_t i = 0, n = prerequisites->size(); i < n; ++i) {
+    Resource& p = getResource((*prerequisites)[i]);
+    hatomic::increment(p.refCount);
+    acquirePrerequisites(p);
+  }
+}
+
+static void cacheResource(Resource& res);
+
+static void releasePrerequisites(Resource const& res) {
+  auto const* prerequisites = res.info->prerequisites();
+  for (uint32_t i = 0, n = prerequisites->size(); i < n; ++i) {
+    Resource& p = getResource((*prerequisites)[i]);
+    // Cache before releasing its own prerequisites so they're still referenced by p
+    if (hatomic::decrement(p.refCount) == 0) cacheResource(p);
+    releasePrerequisites(p);
+  }
+}
+
+static void lruUnlink(TypeCache& tc, Resource& res) {
+  if (res.lruPrev) res.lruPrev->lruNext = res.lruNext;
+  if (res.lruNext) res.lruNext->lruPrev = res.lruPrev;
+  if (tc.head == &res) tc.head = res.lruNext;
+  if (tc.tail == &res) tc.tail = res.lruPrev;
+  res.lruPrev = nullptr;
+  res.lruNext = nullptr;
+  tc.used -= res.info->filesize();
+  res.cached = false;
+}
+
+static void evictResource(TypeCache& tc, Resource& res) {
+  lruUnlink(tc, res);
+  destroyResource(res);
+  releasePrerequisites(res);
+}
+
+static void trimCache(TypeCache& tc) {
+  while (tc.used > tc.budget && tc.tail) {
+    evictResource(tc, *tc.tail);
+  }
+}
+
+// Called when the ref count of a loaded resource hits zero. The resource takes a reference on its prerequisites while
+// cached, so a cache hit never finds a dependency destroyed underneath it.
+static void cacheResource(Resource& res) {
+  hdbassert(!res.cached, "Resource is already cached");
+  // Nothing worth keeping if deserialising failed, the next load reads the file again
+  if (!res.runtimeData) {
+    destroyResource(res);
+    return;
+  }
+  TypeCache& tc = getTypeCache(res.typecc);
+  acquirePrerequisites(res);
+  res.cached = true;
+  res.lruNext = tc.head;
+  if (tc.head) tc.head->lruPrev = &res;
+  tc.head = &res;
+  if (!tc.tail) tc.tail = &res;
+  tc.used += res.info->filesize();
+  trimCache(tc);
+}
+
+// Cache hit. Caller has already taken the new reference on res.
+static void uncacheResource(Resource& res) {
+  lruUnlink(getTypeCache(res.typecc), res);
+  releasePrerequisites(res);
+}
+
+void setCacheBudget(uint32_t typecc, size_t bytes) {
+  hScopedMutex sentry(&ctx.access);
+  TypeCache&   tc = getTypeCache(typecc);
+  tc.budget = bytes;
+  trimCache(tc);
+}
+
+void purgeCache() {
+  hScopedMutex sentry(&ctx.access);
+  // Evicting can push prerequisites into other caches so repeat until nothing is left
+  hstd::vector<uint32_t> types;
+  bool                   evicted;
+  do {
+    evicted = false;
+    types.clear();
+    for (auto const& i : ctx.typeCaches)
+      types.push_back(i.first);
+    for (auto typecc : types) {
+      TypeCache& tc = getTypeCache(typecc);
+      while (tc.tail) {
+        evictResource(tc, *tc.tail);
+        evicted = true;
+      }
+    }
+  } while (evicted);
+}
+
+static LoadTransaction* nextLoad() {
+  for (auto const& q : ctx.loadQueues) {
+    if (!q.empty()) return q.front().get();
+  }
+  return nullptr;
+}
+
+static LoadTransactionPtr removeLoad(LoadTransaction const* t) {
+  LoadTransactionPtr removed;
+  for (auto& q : ctx.loadQueues) {
+    for (auto i = q.begin(), n = q.end(); i != n; ++i) {
+      if (i->get() == t) {
+        removed = std::move(*i);
+        q.erase(i);
+        return removed;
+      }
+    }
+  }
+  return removed;
+}
+
+// Drop the references taken by the part of a transaction that has already loaded. Dependents first.
+static void releaseTransaction(LoadTransaction const& t) {
+  for (uint32_t i = t.next; i > 0; --i) {
+    ctx.unloadQueue.emplace_back(t.resources[i - 1], t.id);
+  }
+}
+
+// True if reading the resource ahead of a load would be useful
+static bool wantsPrefetch(uint32_t slot) {
+  Resource const& res = getResource(slot);
+  return res.prefetch == PrefetchState::None && !res.loadtimeData && !res.cached &&
+         !(hatomic::atomicGet(res.generation) & 1) && hatomic::atomicGet(res.refCount) == 0 && slot != ctx.ioSlot;
+}
+
+static void prefetchTraceInternal(resid_t root) {
+  auto found = ctx.traces.find(root);
+  if (found == ctx.traces.end()) return;
+
+  for (auto const& id : found->second) {
+    uint32_t slot = findSlot(id);
+    // Traces can outlive a resource DB rebuild, skip anything that has gone
+    if (slot == invalidSlot || !wantsPrefetch(slot)) continue;
+    getResource(slot).prefetch = PrefetchState::Queued;
+    ctx.prefetchQueue.push_back(slot);
+  }
+}
+
+static bool wantsSharedCopy(Resource const& res) {
+  return ctx.sharedCache && res.info->contentHash() && res.info->filesize() >= ctx.sharedCacheMinSize;
+}
+
+static void sharedCopyName(Resource const& res, char* out, size_t size) {
+  hcrt::sprintf(out, size, "%s_%016llx%016llx_%016llx", ctx.sharedCachePrefix.c_str(),
+                (unsigned long long)res.uuid.dwords[1], (unsigned long long)res.uuid.dwords[0],
+                (unsigned long long)res.info->contentHash());
+}
+
+// Another process may have already read the file. A rebuilt asset gets a new content hash, so it never matches a copy
+// of its old contents.
+static bool mapSharedCopy(Resource& res) {
+  if (!wantsSharedCopy(res)) return false;
+  char              name[HART_MAX_PATH];
+  hfs::SharedMemory shm;
+  sharedCopyName(res, name, sizeof(name));
+  if (!hfs::openSharedMemory(name, &shm)) return false;
+  // Not ready while it's being written, or if the process writing it died
+  auto const* hdr = (SharedCacheHeader const*)shm.data;
+  if (shm.size < sharedCacheHeaderSize + res.info->filesize() || !hdr->ready.load(std::memory_order_acquire) ||
+      hdr->magic != sharedCacheMagic || hdr->size != res.info->filesize()) {
+    hfs::closeSharedMemory(&shm);
+    return false;
+  }
+  res.loadtimeData.adoptShared(&shm, sharedCacheHeaderSize);
+  ++ctx.sharedHits;
+  return true;
+}
+
+// After a read from disk. Loses quietly to any other process publishing the same copy.
+static void publishSharedCopy(uint32_t slot) {
+  Resource const& res = getResource(slot);
+  size_t          filesize = res.info->filesize();
+  if (!wantsSharedCopy(res) || ctx.sharedPublishedBytes + filesize > ctx.sharedCacheBudget) return;
+  char       name[HART_MAX_PATH];
+  SharedCopy copy;
+  sharedCopyName(res, name, sizeof(name));
+  if (!hfs::createSharedMemory(name, sharedCacheHeaderSize + filesize, &copy.shm)) return;
+  auto* hdr = new (copy.shm.data) SharedCacheHeader();
+  hdr->magic = sharedCacheMagic;
+  hdr->size = filesize;
+  hcrt::memcpy((uint8_t*)copy.shm.data + sharedCacheHeaderSize, res.loadtimeData.get(), filesize);
+  hdr->ready.store(1, std::memory_order_release);
+  copy.slot = slot;
+  ctx.sharedPublished.push_back(copy);
+  ctx.sharedPublishedBytes += filesize;
+}
+
+// Copies this process published go when it shuts down
+static void removeSharedCopies() {
+  char name[HART_MAX_PATH];
+  for (auto& copy : ctx.sharedPublished) {
+    sharedCopyName(getResource(copy.slot), name, sizeof(name));
+    hfs::closeSharedMemory(&copy.shm);
+    hfs::removeSharedMemory(name);
+  }
+  ctx.sharedPublished.clear();
+  ctx.sharedPublishedBytes = 0;
+}
+
+// Large files are streamed past the OS cache, keeping them there would only evict hotter data. IOBuffers are page
+// aligned, so all but the tail of the file skips it.
+static uint32_t openFlags(size_t filesize) {
+  return ctx.directIOMinSize && filesize >= ctx.directIOMinSize ? (uint32_t)hfs::OpenFlag_Direct : 0;
+}
+
+// Reads ahead of a load wait until the bytes already in flight have drained, unless nothing is, so a read bigger
+// than the cap can't be held up forever
+static bool canIssueRead(size_t size) {
+  size_t in_flight = ioBytesInFlight();
+  return in_flight == 0 || in_flight + size <= ctx.maxInFlightBytes;
+}
+
+static void markPrefetchReady(uint32_t slot) {
+  Resource& res = getResource(slot);
+  res.prefetch = PrefetchState::Ready;
+  res.prefetchReadyAt = ctx.prefetchUpdates;
+  ctx.readyPrefetches.push_back({slot, ctx.prefetchUpdates});
+}
+
+// Ready data counts against maxInFlightBytes until a load takes it. A trace can name resources that are never loaded
+// again, so data nobody has taken within prefetchExpiry updates is dropped, or it would hold back every later read.
+static void expireReadyPrefetches() {
+  ++ctx.prefetchUpdates;
+  size_t expired = 0;
+  for (size_t n = ctx.readyPrefetches.size(); expired < n; ++expired) {
+    ReadyPrefetch const& ready = ctx.readyPrefetches[expired];
+    if (ctx.prefetchUpdates - ready.readyAt < ctx.prefetchExpiry) break;
+    Resource& res = getResource(ready.slot);
+    // Otherwise taken by a load, or prefetched again since
+    if (res.prefetch == PrefetchState::Ready && res.prefetchReadyAt == ready.readyAt) {
+      res.prefetch = PrefetchState::None;
+      res.loadtimeData.reset();
+    }
+  }
+  ctx.readyPrefetches.erase(ctx.readyPrefetches.begin(), ctx.readyPrefetches.begin() + expired);
+}
+
+// Read every file a load of a bundled resource needs in one go. Members are handed to the load state machine the
+// same way as prefetched resources.
+static void readBundle(uint32_t bundle_idx) {
+  auto const*   bundle = (*ctx.resourceListings->bundles())[bundle_idx];
+  auto const*   members = bundle->members();
+  BundleReadPtr br(new BundleRead());
+  br->bundle = bundle;
+  for (uint32_t i = 0, n = members->size(); i < n; ++i) {
+    if (wantsPrefetch((*members)[i])) br->members.push_back(i);
+  }
+  if (br->members.empty() || !canIssueRead(bundle->filesize())) return;
+
+  for (auto i : br->members) {
+    getResource((*members)[i]).prefetch = PrefetchState::Reading;
+  }
+  br->data.alloc(bundle->filesize());
+  // The read is issued by finishBundleRead() once the open completes
+  hfs::FileOpHandle op =
+    hfs::openFile(bundle->filepath()->c_str(), hfs::Mode::Read, &br->file, openFlags(bundle->filesize()));
+  hfs::fileOpPost(op, ctx.bundleCompletions, br.release());
+  ++ctx.bundleReads;
+}
+
+static void finishBundleRead(BundleReadPtr br, hfs::Error er) {
+  if (!br->opened && er == hfs::Error::Ok) {
+    br->opened = true;
+    hfs::FileOpHandle op = hfs::freadAsync(br->file, br->data.get(), br->bundle->filesize(), 0);
+    hfs::fileOpPost(op, ctx.bundleCompletions, br.release());
+    ++ctx.bundleReads;
+    return;
+  }
+  hfs::closeFile(br->file);
+  auto const* members = br->bundle->members();
+  auto const* offsets = br->bundle->offsets();
+  for (auto m : br->members) {
+    Resource& res = getResource((*members)[m]);
+    if (er == hfs::Error::Ok) {
+      // Members get their own copy as each may outlive the others (persistFileData)
+      res.loadtimeData.alloc(res.info->filesize());
+      hcrt::memcpy(res.loadtimeData.get(), br->data.get() + (*offsets)[m], res.info->filesize());
+      markPrefetchReady((*members)[m]);
+    } else {
+      // Fall back to reading each member on its own
+      res.prefetch = PrefetchState::None;
+    }
+  }
+}
+
+static void updateBundleReads() {
+  hfs::Completion done[16];
+  for (uint32_t n; ctx.bundleReads && (n = hfs::popCompletions(ctx.bundleCompletions, done, 16)) > 0;) {
+    for (uint32_t i = 0; i < n; ++i) {
+      finishBundleRead(BundleReadPtr((BundleRead*)done[i].userData), done[i].result);
+    }
+    ctx.bundleReads -= n;
+  }
+}
+
+static void finishPrefetchRead(PrefetchRead* pr, hfs::Error er) {
+  Resource& res = getResource(pr->slot);
+  if (!pr->opened && er == hfs::Error::Ok) {
+    pr->opened = true;
+    hfs::FileOpHandle op = hfs::freadAsync(pr->file, res.loadtimeData.get(), res.info->filesize(), 0);
+    hfs::fileOpPost(op, ctx.prefetchCompletions, pr);
+    ++ctx.prefetchReads;
+    return;
+  }
+  // Null when the open failed
+  hfs::closeFile(pr->file);
+  if (er == hfs::Error::Ok) {
+    markPrefetchReady(pr->slot);
+    publishSharedCopy(pr->slot);
+  } else {
+    // The load will read it again and deal with any error
+    res.prefetch = PrefetchState::None;
+    res.loadtimeData.reset();
+  }
+  delete pr;
+}
+
+void prefetchTrace(resid_t res_id) {
   hScopedMutex sentry(&ctx.access);
+  prefetchTraceInternal(res_id);
+}
+
+static void updatePrefetches() {
+  expireReadyPrefetches();
+  updateBundleReads();
+  hfs::Completion done[16];
+  for (uint32_t n; ctx.prefetchReads && (n = hfs::popCompletions(ctx.prefetchCompletions, done, 16)) > 0;) {
+    for (uint32_t i = 0; i < n; ++i) {
+      finishPrefetchRead((PrefetchRead*)done[i].userData, done[i].result);
+    }
+    ctx.prefetchReads -= n;
+  }
+
+  // Issue reads in trace order
+  size_t issued = 0;
+  for (size_t n = ctx.prefetchQueue.size(); issued < n && ctx.prefetchReads < ctx.maxPrefetchReads; ++issued) {
+    uint32_t  slot = ctx.prefetchQueue[issued];
+    Resource& res = getResource(slot);
+    res.prefetch = PrefetchState::None;
+    if (!wantsPrefetch(slot)) continue;
+    if (mapSharedCopy(res)) {
+      markPrefetchReady(slot);
+      continue;
+    }
+    if (!canIssueRead(res.info->filesize())) {
+      res.prefetch = PrefetchState::Queued;
+      break;
+    }
+
+    // Opened without waiting, finishPrefetchRead() issues the read
+    auto* pr = new PrefetchRead{slot, nullptr, false};
+    res.loadtimeData.alloc(res.info->filesize());
+    res.prefetch = PrefetchState::Reading;
+    hfs::FileOpHandle op =
+      hfs::openFile(res.info->filepath()->c_str(), hfs::Mode::Read, &pr->file, openFlags(res.info->filesize()));
+    hfs::fileOpPost(op, ctx.prefetchCompletions, pr);
+    ++ctx.prefetchReads;
+  }
+  ctx.prefetchQueue.erase(ctx.prefetchQueue.begin(), ctx.prefetchQueue.begin() + issued);
+}
+
+// Merge the resources the transaction read from disk into the trace for its root. New entries go on the end, so a
+// trace recorded while some resources were already resident fills in over later runs.
+static void recordLoadTrace(LoadTransaction const& t) {
+  uint32_t root = t.resources.back();
+  uint32_t typecc = getResource(root).typecc;
+  if (!ctx.loadTraces || t.loadedFromDisk.empty() ||
+      std::find(ctx.traceTypes.begin(), ctx.traceTypes.end(), typecc) == ctx.traceTypes.end())
+    return;
+
+  auto& trace = ctx.traces[getResource(root).uuid];
+  bool  changed = false;
+  for (auto slot : t.loadedFromDisk) {
+    resid_t const& id = getResource(slot).uuid;
+    if (std::find(trace.begin(), trace.end(), id) != trace.end()) continue;
+    trace.push_back(id);
+    changed = true;
+  }
+  if (changed) ctx.tracesDirty = true;
+}
+
+// Deserialise and publish the active resource once its file is in loadtimeData
+static void finishLoad(uint32_t slot, htime::Timer const& step_timer) {
+  ResourceLoadData          load_data;
+  hobjfact::SerialiseParams ser_params;
+  Resource&                 res = getResource(slot);
+  initLoadData(res, &load_data);
+  ser_params.resdata = &load_data;
+  htime::Timer deserialise_timer;
+  res.runtimeData =
+    hobjfact::deserialiseObject(res.loadtimeData.get(), res.info->filesize(), &ser_params, &res.typecc);
+  ctx.loadMetrics.deserialiseMS = deserialise_timer.elapsedMS();
+  hatomic::increment(res.refCount);
+  hatomic::increment(res.generation); // publish
+  if (load_data.persistFileData) {
+    res.loadtimeData.markResident();
+  } else {
+    res.loadtimeData.reset();
+  }
+  ctx.loadMetrics.mainThreadMS += step_timer.elapsedMS() - ctx.loadMetrics.deserialiseMS;
+  recordLoadMetrics(res);
+  ctx.activeLoad->loadedFromDisk.push_back(slot);
+  ctx.resState = ResourceLoadState::LoadNext;
+}
+
+// One step of the active load. Returns false once it's waiting on I/O, has nothing to do or would go over the frame's
+// budget by finalising the next resource.
+static bool stepLoad(htime::Timer const& frame_timer, bool* io_finalised) {
+  // Pick the highest priority request between each resource, so a critical load can jump ahead of a large prefetch
+  // that is only part way through its prerequisites.
+  if (ctx.resState == ResourceLoadState::Waiting) {
+    ctx.activeLoad = nextLoad();
+    if (ctx.activeLoad) {
+      ctx.resState = ResourceLoadState::OpenFile;
+      ctx.loadMetrics = LoadMetrics();
+      ctx.loadMetrics.queueWaitMS = ctx.activeLoad->queued.elapsedMS();
+    }
+  }
+  if (ctx.resState == ResourceLoadState::Waiting) return false;
 
   // Process load queue
-  if ((ctx.resState == ResourceLoadState::Waiting && ctx.loadQueue.size() > 0) ||
-      ctx.resState == ResourceLoadState::OpenFile) {
-    LoadRequest& lr = ctx.loadQueue.front();
-    Resource&    res = ctx.resources[lr.uuid];
-    if (hatomic::atomicGet(res.refCount) == 0) {
-      // Need to load
-      ctx.fileOp = hfs::openFile(res.info->filepath()->c_str(), hfs::Mode::Read, &ctx.fileHdl);
-      ctx.resState = ResourceLoadState::OpenFileWait;
+  htime::Timer step_timer;
+  if (ctx.resState == ResourceLoadState::OpenFile) {
+    Resource& res = getResource(ctx.activeLoad->resources[ctx.activeLoad->next]);
+    if (hatomic::atomicGet(res.refCount) == 0 && res.cached) {
+      // Still resident from an earlier load, no I/O needed
+      hatomic::increment(res.refCount);
+      uncacheResource(res);
+      ++ctx.metrics[res.typecc].cacheHits;
+      ctx.resState = ResourceLoadState::LoadNext;
+    } else if (hatomic::atomicGet(res.refCount) == 0 &&
+               (res.prefetch == PrefetchState::Reading || res.prefetch == PrefetchState::Ready)) {
+      ctx.resState = ResourceLoadState::PrefetchWait;
+    } else if (hatomic::atomicGet(res.refCount) == 0) {
+      // Need to load. If it's waiting on a prefetch, it's needed now so read it here instead
+      if (res.prefetch == PrefetchState::Queued) {
+        res.prefetch = PrefetchState::None;
+        ctx.prefetchQueue.erase(std::find(ctx.prefetchQueue.begin(), ctx.prefetchQueue.end(),
+                                           ctx.activeLoad->resources[ctx.activeLoad->next]));
+      }
+      if (mapSharedCopy(res)) {
+        ctx.loadMetrics.ioMS = ctx.loadMetrics.ioTimer.elapsedMS();
+        ctx.resState = ResourceLoadState::LoadResource;
+      } else {
+        ctx.ioSlot = ctx.activeLoad->resources[ctx.activeLoad->next];
+        ctx.fileOp = hfs::openFile(res.info->filepath()->c_str(), hfs::Mode::Read, &ctx.fileHdl,
+                                   openFlags(res.info->filesize()));
+        ctx.resState = ResourceLoadState::OpenFileWait;
+        ctx.loadMetrics.mainThreadMS += step_timer.elapsedMS();
+      }
     } else {
       // just ++ the ref count
       hatomic::increment(res.refCount);
@@ -191,67 +1491,129 @@ void update() {
     }
   } else if (ctx.resState == ResourceLoadState::OpenFileWait) {
     hfs::Error er = hfs::fileOpComplete(ctx.fileOp);
-    if (er == hfs::Error::Pending) return;
+    if (er == hfs::Error::Pending) return false;
     if (er != hfs::Error::Ok) {
       hfs::closeFile(ctx.fileHdl);
       ctx.resState = ResourceLoadState::OpenFile; // Try again!
-      return;
+      return false;
     }
 
-    LoadRequest& lr = ctx.loadQueue.front();
-    Resource&    res = ctx.resources[lr.uuid];
-    if (!res.loadtimeData) res.loadtimeData.reset(new uint8_t[res.info->filesize()]);
+    Resource& res = getResource(ctx.activeLoad->resources[ctx.activeLoad->next]);
+    if (!res.loadtimeData) res.loadtimeData.alloc(res.info->filesize());
     ctx.fileOp = hfs::freadAsync(ctx.fileHdl, res.loadtimeData.get(), res.info->filesize(), 0);
     ctx.resState = ResourceLoadState::ReadFileWait;
+    ctx.loadMetrics.mainThreadMS += step_timer.elapsedMS();
   } else if (ctx.resState == ResourceLoadState::ReadFileWait) {
     hfs::Error er = hfs::fileOpComplete(ctx.fileOp);
-    if (er == hfs::Error::Pending) return;
+    if (er == hfs::Error::Pending) return false;
     if (er != hfs::Error::Ok) {
       hfs::closeFile(ctx.fileHdl);
       ctx.resState = ResourceLoadState::OpenFile; // Try again!
-      return;
+      return false;
     }
 
-    ResourceLoadData          load_data;
-    hobjfact::SerialiseParams ser_params;
-    LoadRequest&              lr = ctx.loadQueue.front();
-    Resource&                 res = ctx.resources[lr.uuid];
-    load_data.friendlyName = res.info->friendlyName()->c_str();
-    ser_params.resdata = &load_data;
+    hfs::closeFile(ctx.fileHdl);
+    publishSharedCopy(ctx.ioSlot);
+    ctx.ioSlot = invalidSlot;
+    ctx.loadMetrics.ioMS = ctx.loadMetrics.ioTimer.elapsedMS();
     ctx.resState = ResourceLoadState::LoadResource;
-    res.runtimeData =
-      hobjfact::deserialiseObject(res.loadtimeData.get(), res.info->filesize(), &ser_params, &res.typecc);
-    hatomic::increment(res.refCount);
-    if (!load_data.persistFileData) {
-      res.loadtimeData.reset();
+  } else if (ctx.resState == ResourceLoadState::PrefetchWait) {
+    uint32_t  slot = ctx.activeLoad->resources[ctx.activeLoad->next];
+    Resource& res = getResource(slot);
+    if (res.prefetch == PrefetchState::Reading) return false;
+    if (res.prefetch == PrefetchState::Ready) {
+      res.prefetch = PrefetchState::None;
+      ctx.loadMetrics.ioMS = ctx.loadMetrics.ioTimer.elapsedMS();
+      ctx.resState = ResourceLoadState::LoadResource;
+    } else {
+      // Prefetch failed, read it normally
+      ctx.resState = ResourceLoadState::OpenFile;
     }
-    ctx.resState = ResourceLoadState::LoadNext;
   }
 
-  // finished loading a resource, remove and carry on to whatevers next.
+  // The file is in loadtimeData. Deserialising is the expensive part of a load, so it's put off to the next frame if
+  // the type's average cost doesn't fit in what's left of the budget. Something is always finalised each frame so a
+  // type costing more than the whole budget still loads.
+  if (ctx.resState == ResourceLoadState::LoadResource) {
+    uint32_t  slot = ctx.activeLoad->resources[ctx.activeLoad->next];
+    Resource& res = getResource(slot);
+    // The typecc is the file identifier, see hobjfact::deserialiseObject(). A file too short to have one has no
+    // estimate, deserialising it fails.
+    uint32_t typecc = 0;
+    if (res.info->filesize() >= 2 * sizeof(flatbuffers::uoffset_t)) {
+      hcrt::memcpy(&typecc, res.loadtimeData.get() + sizeof(flatbuffers::uoffset_t), sizeof(typecc));
+    }
+    auto     found = ctx.metrics.find(typecc);
+    float    estimate_ms = found != ctx.metrics.end() ? found->second.finaliseEstimateMS : 0.f;
+    if (*io_finalised && frame_timer.elapsedMS() + estimate_ms > ctx.loadBudgetMS) {
+      ++ctx.deferredFinalises;
+      return false;
+    }
+    finishLoad(slot, step_timer);
+    *io_finalised = true;
+  }
+
+  // finished loading a resource, move on to the next one in the transaction or retire it.
   if (ctx.resState == ResourceLoadState::LoadNext) {
-    ctx.loadQueue.erase(ctx.loadQueue.begin());
+    LoadTransaction* t = ctx.activeLoad;
+    ++t->next;
+    if (t->cancelled) {
+      // Cancelled while this resource was in flight
+      releaseTransaction(*t);
+      removeLoad(t);
+    } else if (t->next == t->resources.size()) {
+      recordLoadTrace(*t);
+      LoadTransactionPtr done = removeLoad(t);
+      if (done->onLoaded) ctx.completedLoads.push_back(std::move(done));
+    }
+    ctx.activeLoad = nullptr;
     ctx.resState = ResourceLoadState::Waiting;
   }
 
+  return true;
+}
+
+static void updateQueues() {
+  updatePrefetches();
+
+  // Step the load queue until it's waiting on I/O or this frame's main thread budget for loading is spent
+  htime::Timer frame_timer;
+  bool         finalised = false;
+  while (stepLoad(frame_timer, &finalised) && frame_timer.elapsedMS() < ctx.loadBudgetMS) {
+  }
+
   // if load queue is done, process unload queue.
-  // TODO: Time slice this?
-  if (ctx.loadQueue.size() == 0 && ctx.unloadQueue.size() > 0) {
+  if (!nextLoad() && ctx.unloadQueue.size() > 0) {
     ctx.resState = ResourceLoadState::Unload;
     for (auto const& r : ctx.unloadQueue) {
-      Resource& res = ctx.resources[r.uuid];
+      Resource& res = getResource(r.slot);
       if (hatomic::decrement(res.refCount) == 0) {
-        // No more references. So delete this resource
-        const hobjfact::ObjectDefinition* obj_def = hobjfact::getObjectDefinition(res.typecc);
-        obj_def->destruct(res.runtimeData);
-        obj_def->objFree(res.runtimeData);
-        res.runtimeData = nullptr;
-        res.loadtimeData.reset();
+        // No more references. Keep it resident until its type cache is over budget
+        cacheResource(res);
       }
     }
     ctx.unloadQueue.clear();
     ctx.resState = ResourceLoadState::Waiting;
   }
+
+  processDestroyQueue(ctx.unloadBudgetMS);
+  kickFreeTasks(false);
+}
+
+void update() {
+  hstd::vector<LoadTransactionPtr> completed;
+  {
+    hScopedMutex sentry(&ctx.access);
+#if HART_DEBUG_INFO
+    updateHotReload();
+#endif
+    updateQueues();
+    completed.swap(ctx.completedLoads);
+  }
+  // Outside the lock so callbacks are free to load or unload other resources
+  for (auto const& t : completed) {
+    t->onLoaded(t->hdl);
+  }
 }
 
 static void flushResourceQueue() {
@@ -261,105 +1623,281 @@ static void flushResourceQueue() {
 }
 
 void shutdown() {
+  {
+    hScopedMutex sentry(&ctx.access);
+    // Drain everything. The second kick waits on the frees the first one started
+    processDestroyQueue(FLT_MAX);
+    kickFreeTasks(true);
+    kickFreeTasks(true);
+    // Reads still in flight write into buffers that are about to be freed, opens into the handle
+    if (ctx.resState == ResourceLoadState::OpenFileWait || ctx.resState == ResourceLoadState::ReadFileWait) {
+      hfs::fileOpWait(ctx.fileOp);
+      hfs::closeFile(ctx.fileHdl);
+      ctx.resState = ResourceLoadState::Waiting;
+    }
+    hfs::Completion done;
+    for (; ctx.prefetchReads; --ctx.prefetchReads) {
+      hfs::waitCompletions(ctx.prefetchCompletions, &done, 1);
+      finishPrefetchRead((PrefetchRead*)done.userData, done.result);
+    }
+    for (; ctx.bundleReads; --ctx.bundleReads) {
+      hfs::waitCompletions(ctx.bundleCompletions, &done, 1);
+      finishBundleRead(BundleReadPtr((BundleRead*)done.userData), done.result);
+    }
+    if (ctx.tracesDirty) writeLoadTraces();
+    ctx.tracesDirty = false;
+    hfs::destroyCompletionQueue(ctx.prefetchCompletions);
+    hfs::destroyCompletionQueue(ctx.bundleCompletions);
+    ctx.prefetchCompletions = ctx.bundleCompletions = nullptr;
+  }
 #if HART_DEBUG_INFO
   engine::removeDebugMenu(ctx.dbmenuHdl);
+  engine::removeDebugMenu(ctx.dbmetricsHdl);
+  hfs::closeWatch(ctx.watch);
+  ctx.watch = nullptr;
 #endif
+  removeSharedCopies();
+  for (uint32_t i = 0, n = (ctx.resourceCount >> resourcePageShift) + 1; i < n; ++i) {
+    delete hatomic::atomicSet(ctx.resourcePages[i], (ResourcePage*)nullptr);
+  }
+  freeIdleIOBuffers();
+  ctx.resourceListings = nullptr;
+  hfs::unmapFile(&ctx.resourcedb);
 }
 
-static void loadResourceInternal(resid_t res_id) {
-  auto const* asset_uuids = ctx.resourceListings->assetUUIDs();
-  auto const* asset_infos = ctx.resourceListings->assetInfos();
+static void loadResourceInternal(uint32_t slot, hstd::vector<uint32_t>* o_resources) {
+  // Flattened by the builder, prerequisites first and without duplicates
+  auto const* closure = getResource(slot).info->dependencyClosure();
+  if (closure) {
+    o_resources->reserve(o_resources->size() + closure->size());
+    for (uint32_t i = 0, n = closure->size(); i < n; ++i) {
+      o_resources->push_back((*closure)[i]);
+    }
+    return;
+  }
 
-  // Push the prerequisites first
-  Resource const& res = ctx.resources[res_id];
-  auto const*     prerequisites = res.info->prerequisites();
+  // Older DB or no prerequisites. Push the prerequisites first
+  auto const* prerequisites = getResource(slot).info->prerequisites();
   for (uint32_t i = 0, n = prerequisites->size(); i < n; ++i) {
-    uint32_t ridx = (*prerequisites)[i];
-    resid_t  id;
-    id.words[3] = (*asset_uuids)[ridx]->highword3();
-    id.words[2] = (*asset_uuids)[ridx]->highword2();
-    id.words[1] = (*asset_uuids)[ridx]->highword1();
-    id.words[0] = (*asset_uuids)[ridx]->lowword();
-    loadResourceInternal(id);
+    loadResourceInternal((*prerequisites)[i], o_resources);
   }
 
   // Loads are handled in order so push this request after the prerequisites
-  ctx.loadQueue.emplace_back(res_id, ctx.transactions);
+  o_resources->push_back(slot);
 }
 
-void loadResource(resid_t res_id, HandleBase* hdl) {
-  hScopedMutex sentry(&ctx.access);
-  ++ctx.transactions;
+void loadResource(resid_t res_id, HandleBase* hdl, LoadPriority priority, LoadCallback const& on_loaded) {
+  uint32_t slot = findSlot(res_id);
+  hdbassert(slot != invalidSlot, "Resource isn't in the resource database");
+  if (slot == invalidSlot) return;
 
-  loadResourceInternal(res_id);
+  hScopedMutex       sentry(&ctx.access);
+  LoadTransactionPtr t(new LoadTransaction());
+  t->id = ++ctx.transactions;
+  t->hdl = hdl;
+  t->onLoaded = on_loaded;
+  loadResourceInternal(slot, &t->resources);
 
   hdl->id = res_id;
-  hdl->info = &ctx.resources[res_id];
+  hdl->slot = slot;
+  hdl->data = nullptr;
+  hdl->transaction = t->id;
+  ctx.loadQueues[(uint32_t)priority].push_back(std::move(t));
+  int32_t bundle = getResource(slot).info->bundle();
+  if (bundle >= 0 && ctx.resourceListings->bundles()) readBundle(bundle);
+  // Get the reads of anything recorded for this resource last time in flight together, up front
+  if (ctx.loadTraces) prefetchTraceInternal(getResource(slot).uuid);
 }
 
-static void unloadResourceInternal(resid_t res_id) {
-  auto const* asset_uuids = ctx.resourceListings->assetUUIDs();
-  auto const* asset_infos = ctx.resourceListings->assetInfos();
+bool cancelLoad(HandleBase* hdl) {
+  hScopedMutex sentry(&ctx.access);
+  LoadTransaction* t = nullptr;
+  for (auto const& q : ctx.loadQueues) {
+    for (auto const& i : q) {
+      if (i->id == hdl->transaction) t = i.get();
+    }
+  }
+  if (!t || t->cancelled) return false;
+
+  if (t == ctx.activeLoad) {
+    // Let the in flight resource finish, update() drops the transaction after
+    t->cancelled = true;
+  } else {
+    releaseTransaction(*t);
+    removeLoad(t);
+  }
+  hdl->id = resid_t();
+  hdl->slot = invalidSlot;
+  hdl->generation = 0;
+  hdl->data = nullptr;
+  hdl->typecc = 0;
+  hdl->transaction = 0;
+  return true;
+}
+
+static void unloadResourceInternal(uint32_t slot) {
+  // Must release exactly what loadResourceInternal() acquired, so walk the same list backwards
+  auto const* closure = getResource(slot).info->dependencyClosure();
+  if (closure) {
+    for (uint32_t i = closure->size(); i > 0; --i) {
+      ctx.unloadQueue.emplace_back((*closure)[i - 1], ctx.transactions);
+    }
+    return;
+  }
 
   // Unloads are handled in order so push this request before its prerequisites
-  ctx.unloadQueue.emplace_back(res_id, ctx.transactions);
+  ctx.unloadQueue.emplace_back(slot, ctx.transactions);
 
   // Now the resource dependent on the prerequisites is gone, unload the prerequisites
-  Resource const& res = ctx.resources[res_id];
-  auto const*     prerequisites = res.info->prerequisites();
+  auto const* prerequisites = getResource(slot).info->prerequisites();
   for (uint32_t i = 0, n = prerequisites->size(); i < n; ++i) {
-    uint32_t ridx = (*prerequisites)[i];
-    resid_t  id;
-    id.words[3] = (*asset_uuids)[ridx]->highword3();
-    id.words[2] = (*asset_uuids)[ridx]->highword2();
-    id.words[1] = (*asset_uuids)[ridx]->highword1();
-    id.words[0] = (*asset_uuids)[ridx]->lowword();
-    unloadResourceInternal(id);
+    unloadResourceInternal((*prerequisites)[i]);
   }
 }
 
 void unloadResource(HandleBase* hdl) {
+  if (!hdl->valid()) return; // e.g. a cancelled load
   hScopedMutex sentry(&ctx.access);
   ++ctx.transactions;
 
-  unloadResourceInternal(hdl->id);
+  unloadResourceInternal(hdl->slot);
 }
 
+// Lock free read of a slot. The generation is read either side of runtimeData & typecc, if it's even or changed
+// while reading, the resource is being (or has been) unloaded.
+static void* resolveResource(Resource const& res, uint32_t* o_typecc, int32_t* o_generation) {
+  int32_t generation = hatomic::atomicGet(res.generation);
+  if (!(generation & 1)) return nullptr;
 
-bool checkResourceLoaded(resid_t res_id) {
-  hScopedMutex sentry(&ctx.access);
+  void*    data = res.runtimeData;
+  uint32_t typecc = res.typecc;
+  if (hatomic::atomicGet(res.generation) != generation) return nullptr;
 
-  Resource& res = ctx.resources[res_id];
-  return !!res.runtimeData;
+  *o_typecc = typecc;
+  *o_generation = generation;
+  return data;
 }
 
-static void* getResourceDataPtrInternal(resid_t res_id, uint32_t* o_typecc) {
-  hdbassert(o_typecc, "o_typecc must not be null");
-  hScopedMutex sentry(&ctx.access);
-
-  Resource& res = ctx.resources[res_id];
-  if (!res.runtimeData) return nullptr;
-
-  *o_typecc = res.typecc;
-  return res.runtimeData;
+bool checkResourceLoaded(resid_t res_id) {
+  uint32_t        slot = findSlot(res_id);
+  Resource const* res = (slot != invalidSlot) ? peekResource(slot) : nullptr;
+  return res && (hatomic::atomicGet(res->generation) & 1);
 }
 
 void weakGetResource(resid_t res_id, WeakHandleBase* hdl) {
+  uint32_t typecc = 0;
+  int32_t  generation;
+  uint32_t        slot = findSlot(res_id);
+  Resource const* res = (slot != invalidSlot) ? peekResource(slot) : nullptr;
+  hdl->data = res ? resolveResource(*res, &typecc, &generation) : nullptr;
 #if HART_DEBUG_INFO
-  hdl->data = getResourceDataPtrInternal(res_id, &hdl->typecc);
-#else
-  uint32_t typecc;
-  hdl->data = getResourceDataPtrInternal(res_id, &typecc);
+  hdl->typecc = typecc;
 #endif
 }
 
 bool HandleBase::loaded() {
-  if (data) return true;
+  if (slot == invalidSlot) return false;
+  // loadResource() created the slot's page
+  Resource const& res = *peekResource(slot);
+  if (data && hatomic::atomicGet(res.generation) == generation) return true;
 
-  data = getResourceDataPtrInternal(id, &typecc);
+  data = resolveResource(res, &typecc, &generation);
   return !!data;
 }
 
+void* HandleBase::getDataRaw(uint32_t expected_typecc) {
+  // Resolve again if the slot has changed state (e.g. been reloaded) since this handle last looked
+  if (slot != invalidSlot && hatomic::atomicGet(peekResource(slot)->generation) != generation) loaded();
+  hdbassert(data, "Asset is not loaded yet. Check with call to loaded() first.");
+  return (expected_typecc == typecc) ? data : nullptr;
+}
+
+void ResourceLoadData::getPrerequisite(uint32_t index, resid_t const& res_id, WeakHandleBase* hdl) const {
+  // res_id can be an alias of the prerequisite, see findSlot()
+  hdbassert(index < prerequisiteCount &&
+              (prerequisites[index].id == res_id || findSlot(res_id) == findSlot(prerequisites[index].id)),
+            "%s: prerequisite %u isn't the expected resource. Is the resource DB out of date?", friendlyName, index);
+  hdl->data = prerequisites[index].data;
+#if HART_DEBUG_INFO
+  hdl->typecc = prerequisites[index].typecc;
+#endif
+}
+
+void ResourceLoadData::findPrerequisite(resid_t const& res_id, WeakHandleBase* hdl) const {
+  for (uint32_t i = 0; i < prerequisiteCount; ++i) {
+    if (prerequisites[i].id == res_id) {
+      hdl->data = prerequisites[i].data;
+#if HART_DEBUG_INFO
+      hdl->typecc = prerequisites[i].typecc;
+#endif
+      return;
+    }
+  }
+  weakGetResource(res_id, hdl);
+}
+
+static void appendf(hstd::string* out, const char* fmt, ...) {
+  char    buf[256];
+  va_list args;
+  va_start(args, fmt);
+  hcrt::vsprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  *out += buf;
+}
+
+static void appendHistogramJSON(hstd::string* out, const char* name, Histogram const& h) {
+  appendf(out, "      \"%s\": { \"count\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+               "\"max\": %llu },\n",
+          name, (unsigned long long)h.count, (unsigned long long)h.mean(), (unsigned long long)h.percentile(.5f),
+          (unsigned long long)h.percentile(.9f), (unsigned long long)h.percentile(.99f), (unsigned long long)h.max);
+}
+
+bool dumpMetrics(const char* path) {
+  hstd::string json;
+  {
+    hScopedMutex sentry(&ctx.access);
+    json += "{\n  \"types\": [";
+    bool first = true;
+    for (auto const& i : ctx.metrics) {
+      TypeMetrics const& m = i.second;
+      char               typecc[5];
+      (*(uint32_t*)typecc) = i.first;
+      typecc[4] = 0;
+      appendf(&json, "%s\n    {\n      \"type\": \"%s\",\n", first ? "" : ",", typecc);
+      appendHistogramJSON(&json, "queueWaitUS", m.queueWaitUS);
+      appendHistogramJSON(&json, "ioUS", m.ioUS);
+      appendHistogramJSON(&json, "deserialiseUS", m.deserialiseUS);
+      appendHistogramJSON(&json, "mainThreadUS", m.finaliseUS);
+      appendHistogramJSON(&json, "bytesRead", m.bytesRead);
+      appendf(&json,
+              "      \"cacheHits\": %llu,\n      \"bytesResident\": %llu,\n      \"peakBytesResident\": %llu,\n"
+              "      \"finaliseEstimateUS\": %llu\n    }",
+              (unsigned long long)m.cacheHits, (unsigned long long)m.bytesResident,
+              (unsigned long long)m.peakBytesResident, (unsigned long long)(m.finaliseEstimateMS * 1000.f));
+      first = false;
+    }
+    json += "\n  ],\n";
+    appendf(&json, "  \"deferredFinalises\": %llu,\n", (unsigned long long)ctx.deferredFinalises);
+    appendf(&json,
+            "  \"sharedCache\": {\n    \"hits\": %llu,\n    \"published\": %llu,\n    \"publishedBytes\": %llu\n"
+            "  },\n",
+            (unsigned long long)ctx.sharedHits, (unsigned long long)ctx.sharedPublished.size(),
+            (unsigned long long)ctx.sharedPublishedBytes);
+    hScopedMutex pool_sentry(&ioPool.access);
+    appendf(&json,
+            "  \"ioBuffers\": {\n    \"allocs\": %llu,\n    \"reuses\": %llu,\n    \"liveBytes\": %llu,\n"
+            "    \"residentBytes\": %llu,\n    \"idleBytes\": %llu\n  }\n}\n",
+            (unsigned long long)ioPool.allocs, (unsigned long long)ioPool.reuses, (unsigned long long)ioPool.liveBytes,
+            (unsigned long long)ioPool.residentBytes, (unsigned long long)ioPool.idleBytes);
+  }
+
+  hfs::FileHandle file;
+  if (hfs::fileOpWait(hfs::openFile(path, hfs::Mode::Write, &file)) != hfs::Error::Ok) return false;
+  hfs::Error er = hfs::fileOpWait(hfs::fwriteAsync(file, json.c_str(), json.size(), 0));
+  hfs::closeFile(file);
+  return er == hfs::Error::Ok;
+}
+
 bool Collection::deserialiseObject(MarshallType const* in_data, hobjfact::SerialiseParams const&) {
   auto const* assets = in_data->assetUUIDs();
   for (uint32_t i = 0, n = assets->size(); i < n; ++i) {
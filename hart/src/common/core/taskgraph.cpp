@@ -233,6 +233,7 @@ bool initialise(int32_t worker_count, uint32_t job_queue_size) {
 
 void destroy() {
   schedulerKillSemphore.Post();
+  schedulerSemphore.Post(); // wake the scheduler so it sees the kill
   schedulerThread.join();
 }
 }
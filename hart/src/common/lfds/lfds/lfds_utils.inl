@@ -246,7 +246,7 @@ static LFDS_INLINE lfds_atom_t lfds_abstraction_increment( volatile lfds_atom_t
 
 
 /****************************************************************************/
-#if (defined LFDS_PLATFORMLINUX && !defined LFDS_BUILD_64_BIT)
+#if (defined LFDS_PLATFORM_LINUX && !defined LFDS_BUILD_64_BIT)
 
   /* TRD : any OS on x86 or ARM with GCC 4.1.0 or better
 
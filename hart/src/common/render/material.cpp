@@ -35,18 +35,19 @@ static bgfx::UniformType::Enum MaterialInputTypeToUniformType[resource::Material
 
 bool Material::deserialiseObject(MarshallType const* in_data, hobjfact::SerialiseParams const& params) {
   auto const* in_tech = in_data->techniques();
-  params.resdata->persistFileData = true;
   techniques.resize(in_tech->size());
+  // update_prerequisites.py lists the vertex then pixel shader of each pass, in order
+  uint32_t shader_idx = 0;
   for (uint32_t i = 0, n = in_tech->size(); i < n; ++i) {
     Technique* tech = &techniques[i];
     tech->type = (*in_tech)[i]->name();
     auto const* in_pass = (*in_tech)[i]->passes();
     tech->passes.resize(in_pass->size());
-    for (uint32_t p = 0, pn = in_pass->size(); p < n; ++p) {
+    for (uint32_t p = 0, pn = in_pass->size(); p < pn; ++p) {
       Pass* pass = &tech->passes[p];
       pass->state.deserialiseObject((*in_pass)[p]->state(), params);
-      hresmgr::weakGetResource(uuid::fromData(*(*in_pass)[p]->vertex()), &pass->vertex);
-      hresmgr::weakGetResource(uuid::fromData(*(*in_pass)[p]->pixel()), &pass->pixel);
+      params.resdata->getPrerequisite(shader_idx++, uuid::fromData(*(*in_pass)[p]->vertex()), &pass->vertex);
+      params.resdata->getPrerequisite(shader_idx++, uuid::fromData(*(*in_pass)[p]->pixel()), &pass->pixel);
       pass->program = createProgram(pass->vertex.getData(), pass->pixel.getData());
     }
   }
@@ -54,13 +55,22 @@ bool Material::deserialiseObject(MarshallType const* in_data, hobjfact::Serialis
   auto const* in_inputs = in_data->defaultInputs();
   if (!in_inputs) return true;
   inputs.resize(in_inputs->size());
+  // Names are copied so the file doesn't need to stay resident
+  uint32_t nameslen = 0;
+  for (uint32_t i = 0, n = in_inputs->size(); i < n; ++i) {
+    nameslen += (*in_inputs)[i]->name()->size() + 1;
+  }
+  inputNames.reserve(nameslen);
   uint32_t datalen = 0;
   for (uint32_t i = 0, n = in_inputs->size(); i < n; ++i) {
     resource::MaterialInput const* in_input = (*in_inputs)[i];
-    inputs[i].name = in_input->name()->c_str();
+    char const*                    name = in_input->name()->c_str();
+    inputs[i].nameIdx = (uint32_t)inputNames.size();
+    inputNames.insert(inputNames.end(), name, name + in_input->name()->size() + 1);
     inputs[i].dataType = in_input->data_type();
     inputs[i].dataIdx = Input::Invalid;
-    inputs[i].uniform = bgfx::createUniform(inputs[i].name, MaterialInputTypeToUniformType[inputs[i].dataType]);
+    inputs[i].uniform =
+      bgfx::createUniform(getInputName(inputs[i]), MaterialInputTypeToUniformType[inputs[i].dataType]);
     if (void const* raw_data = in_input->data()) {
       switch (inputs[i].dataType) {
       case resource::MaterialInputData_Vec3Input: {
@@ -117,7 +127,7 @@ bool Material::deserialiseObject(MarshallType const* in_data, hobjfact::Serialis
         if (t->wrapU() == resource::TextureWrap_Clamp) flags |= BGFX_TEXTURE_U_CLAMP;
         if (t->wrapV() == resource::TextureWrap_Clamp) flags |= BGFX_TEXTURE_V_CLAMP;
         TextureResWeakHandle thdl;
-        if (t->resid()) hresmgr::weakGetResource(huuid::fromData(*t->resid()), &thdl);
+        if (t->resid()) params.resdata->findPrerequisite(huuid::fromData(*t->resid()), &thdl);
         MaterialTextureSlot tslot = {nullptr, t->resid() ? thdl->texture : invalid_tex, t->slot(), flags};
         inputData.resize(datalen + sizeof(tslot));
         hcrt::memcpy(&inputData[datalen], &tslot, sizeof(tslot));
@@ -174,8 +184,9 @@ void Material::setParameters(MaterialHandleData const* hrestrict in_data, uint32
   }
 }
 
-bool MaterialSetup::deserialiseObject(MarshallType const* in_data, hobjfact::SerialiseParams const&) {
-  hresmgr::weakGetResource(uuid::fromData(*in_data->material()), &material);
+bool MaterialSetup::deserialiseObject(MarshallType const* in_data, hobjfact::SerialiseParams const& params) {
+  // update_prerequisites.py puts the material first
+  params.resdata->getPrerequisite(0, uuid::fromData(*in_data->material()), &material);
   // Process inputs
   auto const* in_inputs = in_data->inputs();
   if (!in_inputs) return true;
@@ -232,7 +243,7 @@ bool MaterialSetup::deserialiseObject(MarshallType const* in_data, hobjfact::Ser
         if (t->wrapU() == resource::TextureWrap_Clamp) flags |= BGFX_TEXTURE_U_CLAMP;
         if (t->wrapV() == resource::TextureWrap_Clamp) flags |= BGFX_TEXTURE_V_CLAMP;
         Material::TextureResWeakHandle thdl;
-        hresmgr::weakGetResource(huuid::fromData(*t->resid()), &thdl);
+        params.resdata->findPrerequisite(huuid::fromData(*t->resid()), &thdl);
         MaterialTextureSlot tslot = {nullptr, thdl->texture, t->slot(), flags};
         inputData.resize(inputs[i].dataOffset + inputs[i].dataLen);
         hcrt::memcpy(&inputData[inputs[i].dataOffset], &tslot, sizeof(tslot));
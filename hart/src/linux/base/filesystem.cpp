@@ -0,0 +1,1473 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file LICENSE.txt in the repository root directory.
+*********************************************************************/
+#include "hart/config.h"
+#include "hart/base/mutex.h"
+#include "hart/base/filesystem.h"
+#include "hart/base/pack.h"
+#include "hart/base/util.h"
+#include "hart/base/crt.h"
+#include "hart/base/debug.h"
+#include "hart/base/atomic.h"
+#include "hart/base/semaphore.h"
+#include "hart/base/thread.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+
+// Everything that reaches the OS is asynchronous, see AsyncIO. Only what's answered from memory, like the files of a
+// pack or the entries of a listed directory, completes before returning and hands out one of the static ops below.
+namespace hart {
+namespace filesystem {
+
+// Mounted with mountPack(). Open until exit, as old mount tables and open files may still use it once unmounted.
+struct PackArchive {
+  ~PackArchive() {
+    if (fd >= 0) close(fd);
+  }
+
+  int       fd = -1;
+  PackIndex index;
+};
+
+struct File {
+  int fd = -1;
+  int directFd = -1; // O_DIRECT, when opened with OpenFlag_Direct and the file system allows it
+  // Files and directories in a pack, fd is the archive's
+  PackArchive*     pack = nullptr;
+  PackEntry const* packEntry = nullptr;
+};
+
+// Listed in full by openDir() on an I/O thread, readDir() hands the entries out from memory
+struct hDir : File {
+  struct Listed {
+    uint32_t name; // into names, terminated
+    uint32_t typeFlags;
+  };
+  std::string         names;
+  std::vector<Listed> listed;
+  size_t              next = 0;
+  uint32_t            packNext = 0; // entries of a pack directory left to read
+  uint32_t            packEnd = 0;
+};
+
+struct FileOp {
+  virtual ~FileOp() {}
+};
+
+enum class AsyncOpKind : uint8_t {
+  Read,
+  Write,
+  Stat,
+  Open,
+  Close,
+  ListDir, // always on a worker thread, io_uring can't read directories
+  Batch,   // never submitted itself, done when each of its reads is
+};
+
+// Freed by fileOpComplete() or fileOpWait() once it's done, as on win32
+struct FileOpAsync : FileOp {
+  FileOpAsync() { signal.Create(0, 1); }
+  ~FileOpAsync() { signal.Destroy(); }
+
+  AsyncOpKind        kind;
+  int                fd;
+  uint8_t*           buffer = nullptr;
+  size_t             size = 0;
+  size_t             done = 0; // bytes, reads and writes can complete in parts
+  uint64_t           offset = 0;
+  FileStat*          statOut = nullptr;
+  iovec              iov;
+  std::vector<iovec> segments; // of a read merged from several in a batch, buffer is unused
+  std::vector<iovec> iovs;     // what's left of segments
+  struct statx       stx;
+  int                directFd = -1;
+  size_t             directSize = 0; // leading bytes that go through directFd, the rest through fd
+  // Opens and listings fill in file, handed to fileOut if they succeed. The path is native.
+  std::string        path;
+  int                openFlags = 0;
+  bool               openDirect = false; // open a second descriptor with O_DIRECT once file->fd is open
+  File*              file = nullptr;
+  FileHandle*        fileOut = nullptr;
+  bool               detached = false; // nobody waits on it, freed as it finishes
+  FileOpAsync*       batch = nullptr;
+  uint32_t           remaining = 0; // reads left in a batch
+  Error              batchResult = Error::Ok;
+  hatomic::aint32_t  result = {(int32_t)Error::Pending};
+  hSemaphore         signal; // posted as it finishes, unless it's posted to a queue
+  // Set by fileOpPost()
+  bool               posted = false;
+  CompletionQueue*   queue = nullptr;
+  CompletionCallback callback = nullptr;
+  void*              userData = nullptr;
+};
+
+struct CompletionQueue {
+  hMutex                  access;
+  std::vector<Completion> ready;
+  hSemaphore              available; // posted once per completion in ready
+};
+
+struct Mount {
+  std::string  mountName;
+  std::string  mountPoint;
+  PackArchive* pack = nullptr; // serves the mount instead of mountPoint
+};
+
+// Mount names compiled into a radix trie, so finding the longest matching name is one compare per mount along the
+// way. Tables are never changed once published, which lets paths expand without taking g_mountMtx.
+struct MountTable {
+  struct Node {
+    char     first; // labels[label]
+    uint32_t label;
+    uint32_t labelLen;
+    uint32_t firstChild;
+    uint32_t childCount;
+    int32_t  mount; // ending here, or -1
+  };
+  std::vector<Mount> mounts; // in the order they were mounted
+  std::vector<Node>  nodes;  // nodes[0] is the root, each node's children are contiguous
+  std::string        labels;
+};
+
+// inotify watches aren't recursive, so there's one per directory in the tree
+struct Watch {
+  int                                  fd = -1;
+  std::string                          root; // native, with a trailing '/'
+  std::unordered_map<int, std::string> dirs; // watch descriptor to path relative to root
+  std::vector<std::string>             changed;
+  size_t                               nextChanged = 0;
+};
+
+FileOp                      g_syncOp;
+FileOp                      g_syncOpEOF;
+FileOp                      g_syncOpFailed; // failed before anything was issued, e.g. opening a file a pack hasn't got
+hMutex                      g_mountMtx; // serialises changes to the mounts
+hatomic::aptr_t<MountTable> g_mountTable;
+// Every table published, as a reader may still be using an old one. Mounts change a handful of times a run.
+std::vector<std::unique_ptr<MountTable>> g_mountTables;
+std::vector<std::unique_ptr<PackArchive>> g_packArchives; // every pack mounted, under g_mountMtx
+
+// The first mounted of any with the same name wins, as it did when mounts were searched in order
+static void publishMountTable(std::vector<Mount> mounts) {
+  std::unique_ptr<MountTable>           table(new MountTable());
+  std::vector<std::map<char, uint32_t>> children(1);
+  std::vector<int32_t>                  ends(1, -1);
+  for (size_t i = 0, n = mounts.size(); i < n; ++i) {
+    uint32_t node = 0;
+    for (char c : mounts[i].mountName) {
+      auto it = children[node].find(c);
+      if (it != children[node].end()) {
+        node = it->second;
+        continue;
+      }
+      uint32_t child = (uint32_t)children.size();
+      children[node].emplace(c, child);
+      children.emplace_back();
+      ends.push_back(-1);
+      node = child;
+    }
+    if (ends[node] < 0) ends[node] = (int32_t)i;
+  }
+  // Flatten breadth first, merging runs of nodes with one child and no mount into a single label
+  std::vector<uint32_t> from(1, 0); // byte trie node each table node ends at
+  table->nodes.push_back({0, 0, 0, 0, 0, ends[0]});
+  for (size_t i = 0; i < table->nodes.size(); ++i) {
+    table->nodes[i].firstChild = (uint32_t)table->nodes.size();
+    table->nodes[i].childCount = (uint32_t)children[from[i]].size();
+    for (auto const& edge : children[from[i]]) {
+      MountTable::Node child = {edge.first, (uint32_t)table->labels.size(), 1, 0, 0, -1};
+      uint32_t         node = edge.second;
+      table->labels.push_back(edge.first);
+      for (; ends[node] < 0 && children[node].size() == 1; ++child.labelLen) {
+        table->labels.push_back(children[node].begin()->first);
+        node = children[node].begin()->second;
+      }
+      child.mount = ends[node];
+      table->nodes.push_back(child);
+      from.push_back(node);
+    }
+  }
+  table->mounts = std::move(mounts);
+  hatomic::atomicSet(g_mountTable, table.get());
+  g_mountTables.push_back(std::move(table));
+}
+
+// Longest mount name path starts with
+static Mount const* findMount(MountTable const* table, const char* path, size_t* name_len) {
+  Mount const*            found = nullptr;
+  MountTable::Node const* node = table->nodes.data();
+  for (size_t i = 0;;) {
+    if (node->mount >= 0) {
+      found = &table->mounts[node->mount];
+      *name_len = i;
+    }
+    MountTable::Node const* child = table->nodes.data() + node->firstChild;
+    MountTable::Node const* last = child + node->childCount;
+    while (child != last && child->first != path[i])
+      ++child;
+    if (child == last || hcrt::strncmp(table->labels.c_str() + child->label, path + i, child->labelLen) != 0)
+      return found;
+    i += child->labelLen;
+    node = child;
+  }
+}
+
+// Mount names and native paths both start with '/', so expanding is a single lookup in the mount table
+static void getExpanedPath(const char* in_path, char* out_path, size_t max_len) {
+  MountTable const* table = hatomic::atomicGet(g_mountTable);
+  size_t            offset = 0;
+  Mount const*      mnt = table ? findMount(table, in_path, &offset) : nullptr;
+  size_t            slen = hcrt::strlen(in_path);
+  size_t            plen = mnt ? mnt->mountPoint.size() : 0;
+  if (!mnt || (plen + slen - offset + 1) > max_len) {
+    hcrt::strcpy(out_path, max_len, in_path);
+    return;
+  }
+  hcrt::memcpy(out_path, mnt->mountPoint.c_str(), plen);
+  hcrt::memcpy(out_path + plen, in_path + offset, (slen - offset) + 1);
+}
+
+// The pack mounted over path and the entry path names in it, which is null if there's none. Null if path isn't under a
+// pack mount, pack mount points aren't native paths so getExpanedPath() is no use for them.
+static PackArchive* findPackEntry(const char* path, PackEntry const** out_entry) {
+  MountTable const* table = hatomic::atomicGet(g_mountTable);
+  size_t            offset = 0;
+  Mount const*      mnt = table ? findMount(table, path, &offset) : nullptr;
+  if (!mnt || !mnt->pack) return nullptr;
+  *out_entry = mnt->pack->index.find(path + offset);
+  return mnt->pack;
+}
+
+// Reads of a file in a pack are reads of the archive, cut short at the end of the file. False when starting past it.
+static bool toArchiveRead(File const* file, uint64_t* offset, size_t* size) {
+  PackEntry const* entry = file->packEntry;
+  if (*offset >= entry->size) {
+    if (*size) return false;
+  } else if (*size > entry->size - *offset) {
+    *size = (size_t)(entry->size - *offset);
+  }
+  *offset += entry->offset;
+  return true;
+}
+
+void mountPoint(const char* path, const char* mount);
+void getCurrentWorkingDir(char* out, uint32_t bufsize);
+
+bool initialise_filesystem() {
+  char pwd[HART_MAX_PATH];
+  getCurrentWorkingDir(pwd, HART_MAX_PATH);
+  mountPoint(pwd, "/");
+  return true;
+}
+
+// Reads, writes, stats, opens and closes go through io_uring when the kernel has it. Entries are queued as requests are
+// made and handed to the kernel together the next time any op is polled or waited on, which is also when completions
+// are reaped, every one that's ready at once. Without io_uring (older kernels, or blocked by seccomp or sysctl) a few
+// worker threads make the same requests with blocking calls. The workers also list directories, which io_uring can't,
+// and take any op a kernel too old for it turns down, so they're started the first time they're needed.
+static const uint32_t ringEntries = 256;
+static const uint32_t ioWorkerCount = 4;
+
+static struct AsyncIO {
+  hMutex access; // everything below
+  bool   initialised = false;
+  // io_uring, ringFd is -1 when the worker threads are used instead
+  int           ringFd = -1;
+  void*         sqRing = nullptr;
+  void*         cqRing = nullptr;
+  size_t        sqRingSize = 0;
+  size_t        cqRingSize = 0;
+  io_uring_sqe* sqes = nullptr;
+  uint32_t*     sqHead;
+  uint32_t*     sqTail;
+  uint32_t*     sqArray;
+  uint32_t      sqMask;
+  uint32_t      sqEntries;
+  uint32_t*     cqHead;
+  uint32_t*     cqTail;
+  io_uring_cqe* cqes;
+  uint32_t      cqMask;
+  uint32_t      cqEntries;
+  uint32_t      unsubmitted = 0; // queued since the last io_uring_enter()
+  uint32_t      inFlight = 0;    // submitted and not reaped, kept within the completion queue so none are dropped
+  // Ops that found the completion queue full, queued as reaping makes room
+  std::deque<FileOpAsync*> ringBacklog;
+  // Signalled by the kernel for each completion, wakes completionThread to reap ops nobody is polling for. Waiters
+  // sleep on their op's signal and leave the reaping to it, so nobody sleeps holding access.
+  int     eventFd = -1;
+  hThread completionThread;
+  bool    completionThreadStarted = false;
+  bool    stopping = false;
+  // Posted ops that have finished, waiting to be handed to their queue or callback outside the lock
+  std::vector<FileOpAsync*> delivery;
+  // Worker threads
+  bool                     workersStarted = false;
+  std::deque<FileOpAsync*> queue;
+  hSemaphore               work; // posted once per queued op, and once per worker to stop
+  hThread                  workers[ioWorkerCount];
+
+  ~AsyncIO();
+} g_aio;
+
+static int ringEnter(uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+  return (int)syscall(__NR_io_uring_enter, g_aio.ringFd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static bool initRing() {
+  io_uring_params params;
+  hcrt::zeromem(&params, sizeof(params));
+  int fd = (int)syscall(__NR_io_uring_setup, ringEntries, &params);
+  if (fd < 0) return false;
+
+  g_aio.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  g_aio.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) g_aio.sqRingSize = g_aio.cqRingSize = hutil::tmax(g_aio.sqRingSize, g_aio.cqRingSize);
+  g_aio.sqRing = mmap(nullptr, g_aio.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQ_RING);
+  g_aio.cqRing = single_mmap ? g_aio.sqRing
+                             : mmap(nullptr, g_aio.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                    IORING_OFF_CQ_RING);
+  void* sqes = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  int event_fd = eventfd(0, EFD_CLOEXEC);
+  if (g_aio.sqRing == MAP_FAILED || g_aio.cqRing == MAP_FAILED || sqes == MAP_FAILED || event_fd < 0 ||
+      syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD, &event_fd, 1) != 0) {
+    if (g_aio.sqRing != MAP_FAILED) munmap(g_aio.sqRing, g_aio.sqRingSize);
+    if (!single_mmap && g_aio.cqRing != MAP_FAILED) munmap(g_aio.cqRing, g_aio.cqRingSize);
+    if (sqes != MAP_FAILED) munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+    if (event_fd >= 0) close(event_fd);
+    g_aio.sqRing = g_aio.cqRing = nullptr;
+    close(fd);
+    return false;
+  }
+
+  uint8_t* sq = (uint8_t*)g_aio.sqRing;
+  uint8_t* cq = (uint8_t*)g_aio.cqRing;
+  g_aio.ringFd = fd;
+  g_aio.eventFd = event_fd;
+  g_aio.sqes = (io_uring_sqe*)sqes;
+  g_aio.sqHead = (uint32_t*)(sq + params.sq_off.head);
+  g_aio.sqTail = (uint32_t*)(sq + params.sq_off.tail);
+  g_aio.sqArray = (uint32_t*)(sq + params.sq_off.array);
+  g_aio.sqMask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+  g_aio.sqEntries = params.sq_entries;
+  g_aio.cqHead = (uint32_t*)(cq + params.cq_off.head);
+  g_aio.cqTail = (uint32_t*)(cq + params.cq_off.tail);
+  g_aio.cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+  g_aio.cqMask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+  g_aio.cqEntries = params.cq_entries;
+  return true;
+}
+
+// The part of a read or write still to do. Direct ops do the aligned head first, then the rest through the cache.
+static int remainingIOVecs(FileOpAsync* op, iovec const** o_iov) {
+  if (op->segments.empty()) {
+    op->iov.iov_base = op->buffer + op->done;
+    op->iov.iov_len = (op->done < op->directSize ? op->directSize : op->size) - op->done;
+    *o_iov = &op->iov;
+    return 1;
+  }
+  op->iovs.clear();
+  size_t skip = op->done;
+  for (auto const& seg : op->segments) {
+    if (skip >= seg.iov_len) {
+      skip -= seg.iov_len;
+      continue;
+    }
+    op->iovs.push_back({(uint8_t*)seg.iov_base + skip, seg.iov_len - skip});
+    skip = 0;
+  }
+  *o_iov = op->iovs.data();
+  return (int)op->iovs.size();
+}
+
+static int currentFd(FileOpAsync const* op) {
+  return op->done < op->directSize ? op->directFd : op->fd;
+}
+
+// A direct transfer that stops off an aligned boundary, at the end of the file, carries on through the cache
+static void advanceOp(FileOpAsync* op, size_t transferred) {
+  op->done += transferred;
+  if (op->done < op->directSize && (op->done & (directAlignment() - 1)) != 0) op->directSize = op->done;
+}
+
+static uint32_t direntType(dirent const* found) {
+  if (found->d_type == DT_DIR) return (uint32_t)FileEntryType::Dir;
+  if (found->d_type == DT_LNK) return (uint32_t)FileEntryType::SymLink;
+  return (uint32_t)FileEntryType::File;
+}
+
+// A directory that can't be opened lists as empty
+static void listDir(FileOpAsync* op) {
+  auto* dir = static_cast<hDir*>(op->file);
+  DIR*  found_dir = opendir(op->path.c_str());
+  if (!found_dir) return;
+  while (dirent* found = readdir(found_dir)) {
+    dir->listed.push_back({(uint32_t)dir->names.size(), direntType(found)});
+    dir->names.append(found->d_name, hcrt::strlen(found->d_name) + 1);
+  }
+  closedir(found_dir);
+}
+
+// Blocking, for the worker threads and anything io_uring turns down
+static Error runBlocking(FileOpAsync* op) {
+  switch (op->kind) {
+  case AsyncOpKind::Open:
+    // io_uring may have opened the first descriptor already
+    if (op->file->fd < 0) op->file->fd = open(op->path.c_str(), op->openFlags, 0644);
+    if (op->file->fd < 0) return Error::Failed;
+    // Fails on file systems without O_DIRECT
+    if (op->openDirect) op->file->directFd = open(op->path.c_str(), (op->openFlags & ~(O_CREAT | O_TRUNC)) | O_DIRECT);
+    return Error::Ok;
+  case AsyncOpKind::Close: close(op->fd); return Error::Ok;
+  case AsyncOpKind::ListDir: listDir(op); return Error::Ok;
+  default: break;
+  }
+  if (op->kind == AsyncOpKind::Stat) {
+    struct stat st;
+    if (fstat(op->fd, &st) != 0) return Error::Failed;
+    op->statOut->filesize = st.st_size;
+    op->statOut->modifiedDate = st.st_mtime;
+    return Error::Ok;
+  }
+  while (op->done < op->size) {
+    iovec const* iov;
+    int          iov_count = remainingIOVecs(op, &iov);
+    int          fd = currentFd(op);
+    ssize_t      r = op->kind == AsyncOpKind::Read ? preadv(fd, iov, iov_count, (off_t)(op->offset + op->done))
+                                                   : pwritev(fd, iov, iov_count, (off_t)(op->offset + op->done));
+    if (r < 0 && errno == EINTR) continue;
+    // The device wants more alignment than directAlignment()
+    if (r < 0 && errno == EINVAL && fd == op->directFd) {
+      op->directSize = op->done;
+      continue;
+    }
+    if (r < 0 || (r == 0 && op->kind == AsyncOpKind::Write)) return Error::Failed;
+    if (r == 0) break;
+    advanceOp(op, r);
+  }
+  return op->done == 0 && op->size != 0 ? Error::EndOfFile : Error::Ok;
+}
+
+// A read merged from several stops at the end of the file. A request whose range it never reached started at or past
+// the end, as if it had been read on its own.
+static bool segmentPastEnd(FileOpAsync const* op) {
+  size_t start = 0;
+  for (auto const& seg : op->segments) {
+    if (seg.iov_len != 0 && start >= op->done) return true;
+    start += seg.iov_len;
+  }
+  return false;
+}
+
+// Must hold g_aio.access, so a waiter can't free the op between the two
+static void finishOp(FileOpAsync* op, Error result) {
+  if (FileOpAsync* batch = op->batch) {
+    if (result == Error::Ok && segmentPastEnd(op)) result = Error::EndOfFile;
+    if (result == Error::Failed || (result == Error::EndOfFile && batch->batchResult == Error::Ok)) {
+      batch->batchResult = result;
+    }
+    delete op;
+    if (--batch->remaining == 0) finishOp(batch, batch->batchResult);
+    return;
+  }
+  if (op->fileOut) {
+    // A failed open never got as far as a descriptor
+    if (result != Error::Ok) {
+      delete op->file;
+      op->file = nullptr;
+    }
+    *op->fileOut = op->file;
+  }
+  if (op->detached) {
+    delete op;
+    return;
+  }
+  op->result.store((int32_t)result, std::memory_order_release);
+  if (!op->posted) {
+    op->signal.Post();
+    return;
+  }
+  g_aio.delivery.push_back(op);
+  // Reaped by a thread polling some other op, the completion thread hands it on
+  if (g_aio.eventFd >= 0) eventfd_write(g_aio.eventFd, 1);
+}
+
+static void postCompletion(CompletionQueue* queue, CompletionCallback callback, Completion const& completion) {
+  if (queue) {
+    hScopedMutex sentry(&queue->access);
+    queue->ready.push_back(completion);
+    queue->available.Post();
+  }
+  if (callback) callback(completion);
+}
+
+// Outside g_aio.access, callbacks are free to start more I/O
+static void deliverCompletions() {
+  std::vector<FileOpAsync*> finished;
+  {
+    hScopedMutex sentry(&g_aio.access);
+    if (g_aio.delivery.empty()) return;
+    finished.swap(g_aio.delivery);
+  }
+  for (auto* op : finished) {
+    Completion         completion = {op, (Error)op->result.load(std::memory_order_acquire), op->userData};
+    CompletionQueue*   queue = op->queue;
+    CompletionCallback callback = op->callback;
+    delete op;
+    postCompletion(queue, callback, completion);
+  }
+}
+
+static int32_t ioWorker(void*) {
+  for (;;) {
+    g_aio.work.Wait();
+    FileOpAsync* op;
+    {
+      hScopedMutex sentry(&g_aio.access);
+      if (g_aio.queue.empty()) return 0; // stopping
+      op = g_aio.queue.front();
+      g_aio.queue.pop_front();
+    }
+    Error result = runBlocking(op);
+    {
+      hScopedMutex sentry(&g_aio.access);
+      finishOp(op, result);
+    }
+    deliverCompletions();
+  }
+}
+
+// Must hold g_aio.access
+static void queueWorkerOp(FileOpAsync* op) {
+  if (!g_aio.workersStarted) {
+    g_aio.workersStarted = true;
+    g_aio.work.Create(0, INT32_MAX);
+    for (auto& w : g_aio.workers)
+      w.create("hfs::io", hThread::PRIORITY_NORMAL, ioWorker, nullptr);
+  }
+  g_aio.queue.push_back(op);
+  g_aio.work.Post();
+}
+
+// Must hold g_aio.access
+static void initAsyncIO() {
+  if (g_aio.initialised) return;
+  g_aio.initialised = true;
+  initRing();
+}
+
+static void submitQueued();
+static void reapCompletions();
+
+AsyncIO::~AsyncIO() {
+  if (!initialised) return;
+  // Before the ring, a worker finishing a posted op signals its eventfd
+  if (workersStarted) {
+    for (uint32_t i = 0; i < ioWorkerCount; ++i)
+      work.Post();
+    for (auto& w : workers)
+      w.join();
+    work.Destroy();
+  }
+  if (ringFd >= 0) {
+    if (completionThreadStarted) {
+      {
+        hScopedMutex sentry(&access);
+        stopping = true;
+      }
+      eventfd_write(eventFd, 1);
+      completionThread.join();
+    }
+    {
+      // Closes are never waited on, let the last of them finish
+      hScopedMutex sentry(&access);
+      for (submitQueued(); inFlight; submitQueued()) {
+        ringEnter(0, 1, IORING_ENTER_GETEVENTS);
+        reapCompletions();
+      }
+    }
+    close(eventFd);
+    munmap(sqes, sqEntries * sizeof(io_uring_sqe));
+    if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+    munmap(sqRing, sqRingSize);
+    close(ringFd);
+  }
+}
+
+static void submitQueued() {
+  while (g_aio.unsubmitted) {
+    int r = ringEnter(g_aio.unsubmitted, 0, 0);
+    if (r < 0 && errno == EINTR) continue;
+    // Busy or out of memory, tried again on the next poll
+    if (r <= 0) return;
+    g_aio.unsubmitted -= r;
+    g_aio.inFlight += r;
+  }
+}
+
+// Must hold g_aio.access
+static void queueRingOp(FileOpAsync* op) {
+  uint32_t tail = *g_aio.sqTail;
+  if (tail - __atomic_load_n(g_aio.sqHead, __ATOMIC_ACQUIRE) == g_aio.sqEntries) {
+    submitQueued();
+    if (tail - __atomic_load_n(g_aio.sqHead, __ATOMIC_ACQUIRE) == g_aio.sqEntries) {
+      queueWorkerOp(op);
+      return;
+    }
+  }
+  io_uring_sqe* sqe = &g_aio.sqes[tail & g_aio.sqMask];
+  hcrt::zeromem(sqe, sizeof(*sqe));
+  sqe->fd = currentFd(op);
+  sqe->user_data = (uintptr_t)op;
+  if (op->kind == AsyncOpKind::Stat) {
+    sqe->opcode = IORING_OP_STATX;
+    sqe->addr = (uintptr_t) "";
+    sqe->len = STATX_SIZE | STATX_MTIME;
+    sqe->addr2 = (uintptr_t)&op->stx;
+    sqe->statx_flags = AT_EMPTY_PATH;
+  } else if (op->kind == AsyncOpKind::Open) {
+    // The O_DIRECT descriptor is opened once the first is
+    bool direct = op->file->fd >= 0;
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)op->path.c_str();
+    sqe->len = 0644;
+    sqe->open_flags = direct ? (op->openFlags & ~(O_CREAT | O_TRUNC)) | O_DIRECT : op->openFlags;
+  } else if (op->kind == AsyncOpKind::Close) {
+    sqe->opcode = IORING_OP_CLOSE;
+  } else {
+    iovec const* iov;
+    sqe->opcode = op->kind == AsyncOpKind::Read ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->len = remainingIOVecs(op, &iov);
+    sqe->addr = (uintptr_t)iov;
+    sqe->off = op->offset + op->done;
+  }
+  g_aio.sqArray[tail & g_aio.sqMask] = tail & g_aio.sqMask;
+  __atomic_store_n(g_aio.sqTail, tail + 1, __ATOMIC_RELEASE);
+  ++g_aio.unsubmitted;
+}
+
+static void completeRingOp(FileOpAsync* op, int32_t res) {
+  if (res == -EINTR || res == -EAGAIN) {
+    queueRingOp(op);
+  } else if (op->kind == AsyncOpKind::Open && op->file->fd >= 0) {
+    op->file->directFd = res >= 0 ? res : -1;
+    finishOp(op, Error::Ok);
+  } else if ((op->kind == AsyncOpKind::Open || op->kind == AsyncOpKind::Close) && res == -EINVAL) {
+    // Opens and closes need Linux 5.6
+    queueWorkerOp(op);
+  } else if (op->kind == AsyncOpKind::Open) {
+    if (res < 0) {
+      finishOp(op, Error::Failed);
+    } else {
+      op->file->fd = res;
+      if (op->openDirect) {
+        queueRingOp(op);
+      } else {
+        finishOp(op, Error::Ok);
+      }
+    }
+  } else if (op->kind == AsyncOpKind::Close) {
+    finishOp(op, Error::Ok);
+  } else if (op->kind == AsyncOpKind::Stat) {
+    // Statx needs Linux 5.6
+    if (res == -EINVAL) {
+      finishOp(op, runBlocking(op));
+    } else if (res == 0) {
+      op->statOut->filesize = op->stx.stx_size;
+      op->statOut->modifiedDate = op->stx.stx_mtime.tv_sec;
+      finishOp(op, Error::Ok);
+    } else {
+      finishOp(op, Error::Failed);
+    }
+  } else if (res == -EINVAL && op->done < op->directSize) {
+    // The device wants more alignment than directAlignment()
+    op->directSize = op->done;
+    queueRingOp(op);
+  } else if (res < 0 || (res == 0 && op->kind == AsyncOpKind::Write)) {
+    finishOp(op, Error::Failed);
+  } else if (res == 0) {
+    finishOp(op, op->done == 0 && op->size != 0 ? Error::EndOfFile : Error::Ok);
+  } else {
+    advanceOp(op, res);
+    if (op->done < op->size) {
+      // Short, queue the rest
+      queueRingOp(op);
+    } else {
+      finishOp(op, Error::Ok);
+    }
+  }
+}
+
+// Must hold g_aio.access
+static void reapCompletions() {
+  uint32_t head = *g_aio.cqHead;
+  uint32_t tail = __atomic_load_n(g_aio.cqTail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    io_uring_cqe const& cqe = g_aio.cqes[head & g_aio.cqMask];
+    --g_aio.inFlight;
+    completeRingOp((FileOpAsync*)(uintptr_t)cqe.user_data, cqe.res);
+  }
+  __atomic_store_n(g_aio.cqHead, head, __ATOMIC_RELEASE);
+  while (!g_aio.ringBacklog.empty() && g_aio.inFlight + g_aio.unsubmitted < g_aio.cqEntries) {
+    FileOpAsync* op = g_aio.ringBacklog.front();
+    g_aio.ringBacklog.pop_front();
+    queueRingOp(op);
+  }
+}
+
+// Must hold g_aio.access. The kernel turned the last submit down (busy or out of memory) with nothing in flight, so no
+// completion is coming to retry it.
+static bool ringStalled() {
+  return g_aio.unsubmitted && !g_aio.inFlight;
+}
+
+static int32_t completionThreadMain(void*) {
+  for (;;) {
+    eventfd_t count;
+    if (eventfd_read(g_aio.eventFd, &count) != 0 && errno == EINTR) continue;
+    bool stalled;
+    {
+      hScopedMutex sentry(&g_aio.access);
+      if (g_aio.stopping) return 0;
+      reapCompletions();
+      submitQueued();
+      stalled = ringStalled();
+    }
+    deliverCompletions();
+    if (stalled) {
+      usleep(100);
+      eventfd_write(g_aio.eventFd, 1);
+    }
+  }
+}
+
+// Must hold g_aio.access
+static void startCompletionThread() {
+  if (g_aio.completionThreadStarted) return;
+  g_aio.completionThreadStarted = true;
+  g_aio.completionThread.create("hfs::completion", hThread::PRIORITY_NORMAL, completionThreadMain, nullptr);
+}
+
+// Must hold g_aio.access
+static void submitLocked(FileOpAsync* op) {
+  initAsyncIO();
+  if (g_aio.ringFd < 0 || op->kind == AsyncOpKind::ListDir) {
+    queueWorkerOp(op);
+    return;
+  }
+  if (g_aio.inFlight + g_aio.unsubmitted >= g_aio.cqEntries) {
+    g_aio.ringBacklog.push_back(op);
+    return;
+  }
+  queueRingOp(op);
+}
+
+static FileOpHandle submitAsync(FileOpAsync* op) {
+  hScopedMutex sentry(&g_aio.access);
+  submitLocked(op);
+  return op;
+}
+
+Error fileOpComplete(FileOpHandle in_op) {
+  if (&g_syncOp == in_op) {
+    return Error::Ok;
+  }
+  if (&g_syncOpEOF == in_op) {
+    return Error::EndOfFile;
+  }
+  if (&g_syncOpFailed == in_op || !in_op) {
+    return Error::Failed;
+  }
+
+  auto* op = static_cast<FileOpAsync*>(in_op);
+  Error er;
+  {
+    hScopedMutex sentry(&g_aio.access);
+    if (g_aio.ringFd >= 0) {
+      submitQueued();
+      reapCompletions();
+    }
+    er = (Error)op->result.load(std::memory_order_acquire);
+  }
+  if (er != Error::Pending) delete op;
+  return er;
+}
+
+Error fileOpWait(FileOpHandle in_op) {
+  if (&g_syncOp == in_op || &g_syncOpEOF == in_op || &g_syncOpFailed == in_op || !in_op) {
+    return fileOpComplete(in_op);
+  }
+
+  auto* op = static_cast<FileOpAsync*>(in_op);
+  Error er;
+  {
+    hScopedMutex sentry(&g_aio.access);
+    if (g_aio.ringFd >= 0) {
+      // Reaping can queue the rest of a short read, so submit after it
+      reapCompletions();
+      submitQueued();
+      if (op->result.load(std::memory_order_acquire) == (int32_t)Error::Pending) {
+        startCompletionThread();
+        if (ringStalled()) eventfd_write(g_aio.eventFd, 1);
+      }
+    }
+  }
+  // Finished by the completion thread or a worker, or whoever else reaps it first
+  op->signal.Wait();
+  {
+    // Lets the worker that finished it drop the lock before it's freed
+    hScopedMutex sentry(&g_aio.access);
+    er = (Error)op->result.load(std::memory_order_acquire);
+  }
+  delete op;
+  return er;
+}
+
+CompletionQueueHandle createCompletionQueue() {
+  auto* queue = new CompletionQueue();
+  queue->available.Create(0, INT32_MAX);
+  return queue;
+}
+
+void destroyCompletionQueue(CompletionQueueHandle queue) {
+  if (!queue) return;
+  queue->available.Destroy();
+  delete queue;
+}
+
+void fileOpPost(FileOpHandle in_op, CompletionQueueHandle queue, void* user_data, CompletionCallback callback) {
+  if (&g_syncOp == in_op || &g_syncOpEOF == in_op || &g_syncOpFailed == in_op || !in_op) {
+    postCompletion(queue, callback, {in_op, fileOpComplete(in_op), user_data});
+    return;
+  }
+
+  auto* op = static_cast<FileOpAsync*>(in_op);
+  {
+    hScopedMutex sentry(&g_aio.access);
+    op->queue = queue;
+    op->callback = callback;
+    op->userData = user_data;
+    if (op->result.load(std::memory_order_acquire) == (int32_t)Error::Pending) {
+      op->posted = true;
+      if (g_aio.ringFd >= 0) {
+        startCompletionThread();
+        // Nobody is going to poll for it
+        submitQueued();
+        if (ringStalled()) eventfd_write(g_aio.eventFd, 1);
+      }
+      return;
+    }
+  }
+  postCompletion(queue, callback, {op, (Error)op->result.load(std::memory_order_acquire), user_data});
+  delete op;
+}
+
+// Takes one completion per post of available, so a waiter that has already taken its post always finds one
+static uint32_t takeCompletions(CompletionQueue* queue, Completion* out, uint32_t max, uint32_t taken) {
+  hScopedMutex sentry(&queue->access);
+  uint32_t     n = taken;
+  while (n < max && n < queue->ready.size() && queue->available.poll())
+    ++n;
+  std::copy(queue->ready.begin(), queue->ready.begin() + n, out);
+  queue->ready.erase(queue->ready.begin(), queue->ready.begin() + n);
+  return n;
+}
+
+uint32_t popCompletions(CompletionQueueHandle queue, Completion* out, uint32_t max) {
+  return takeCompletions(queue, out, max, 0);
+}
+
+uint32_t waitCompletions(CompletionQueueHandle queue, Completion* out, uint32_t max) {
+  if (max == 0) return 0;
+  queue->available.Wait();
+  return takeCompletions(queue, out, max, 1);
+}
+
+// Packs are read only, and their files always go through the cache
+static FileOpHandle openPackFile(PackArchive* pack, PackEntry const* entry, Mode mode, FileHandle* outhandle) {
+  if (!entry || (entry->flags & PackEntry_Dir) || mode != Mode::Read) {
+    (*outhandle) = nullptr;
+    return &g_syncOpFailed;
+  }
+
+  (*outhandle) = new File();
+  (*outhandle)->fd = pack->fd;
+  (*outhandle)->pack = pack;
+  (*outhandle)->packEntry = entry;
+  return &g_syncOp;
+}
+
+FileOpHandle openFile(const char* filename, Mode mode, FileHandle* outhandle, uint32_t open_flags) {
+  PackEntry const* entry;
+  if (PackArchive* pack = findPackEntry(filename, &entry)) {
+    return openPackFile(pack, entry, mode, outhandle);
+  }
+
+  int flags = O_CLOEXEC;
+  if (mode == Mode::Read) {
+    flags |= O_RDONLY;
+  } else if (mode == Mode::Write) {
+    flags |= O_WRONLY | O_CREAT | O_TRUNC;
+  }
+
+  char path[HART_MAX_PATH];
+  getExpanedPath(filename, path, HART_MAX_PATH);
+  auto* op = new FileOpAsync();
+  op->kind = AsyncOpKind::Open;
+  op->path = path;
+  op->openFlags = flags;
+  // A second descriptor so unaligned parts can still go through the cache
+  op->openDirect = (open_flags & OpenFlag_Direct) != 0;
+  op->file = new File();
+  op->fileOut = outhandle;
+  return submitAsync(op);
+}
+
+// Must hold g_aio.access
+static void queueClose(int fd) {
+  if (fd < 0) return;
+  auto* op = new FileOpAsync();
+  op->kind = AsyncOpKind::Close;
+  op->fd = fd;
+  op->detached = true;
+  submitLocked(op);
+}
+
+// The descriptors are closed in the background, nothing waits on it
+void closeFile(FileHandle handle) {
+  if (!handle) return;
+  {
+    hScopedMutex sentry(&g_aio.access);
+    if (!handle->pack) queueClose(handle->fd);
+    queueClose(handle->directFd);
+    if (g_aio.ringFd >= 0) submitQueued();
+  }
+  delete handle;
+}
+
+// The page size covers the logical block size of any device likely to be in use
+size_t directAlignment() {
+  static const size_t alignment = (size_t)sysconf(_SC_PAGESIZE);
+  return alignment;
+}
+
+void* allocDirectBuffer(size_t size) {
+  size_t alignment = directAlignment();
+  return hcrt::alignedMalloc((size + alignment - 1) & ~(alignment - 1), alignment);
+}
+
+void freeDirectBuffer(void* buffer) {
+  hcrt::alignedFree(buffer);
+}
+
+static void packDirEntry(PackIndex const& index, PackEntry const& entry, DirEntry* out) {
+  index.getName(entry, out->filename, HART_ARRAYSIZE(out->filename));
+  out->typeFlags = (uint32_t)(entry.flags & PackEntry_Dir ? FileEntryType::Dir : FileEntryType::File);
+}
+
+FileOpHandle openDir(const char* path, FileHandle* outhandle) {
+  auto* dir = new hDir();
+  char  pattern[HART_MAX_PATH];
+  char  dirpath[HART_MAX_PATH];
+  // win32 takes a search pattern (e.g. "dir/*"), only the directory part is used here
+  hcrt::strcpy(pattern, HART_MAX_PATH, path);
+  size_t len = hcrt::strlen(pattern);
+  if (len && pattern[len - 1] == '*') {
+    pattern[len - 1] = 0;
+  }
+  // A pack directory lists its entries in name order, without "." and ".."
+  PackEntry const* entry;
+  if ((dir->pack = findPackEntry(pattern, &entry))) {
+    if (entry && (entry->flags & PackEntry_Dir)) {
+      dir->packNext = entry->firstChild;
+      dir->packEnd = entry->firstChild + entry->childCount;
+    }
+    *outhandle = dir;
+    return &g_syncOp;
+  }
+
+  getExpanedPath(pattern, dirpath, HART_MAX_PATH);
+  auto* op = new FileOpAsync();
+  op->kind = AsyncOpKind::ListDir;
+  op->path = dirpath;
+  op->file = dir;
+  op->fileOut = outhandle;
+  return submitAsync(op);
+}
+
+FileOpHandle readDir(FileHandle dirhandle, DirEntry* out) {
+  auto* dir = static_cast<hDir*>(dirhandle);
+  if (dir->pack) {
+    if (dir->packNext == dir->packEnd) return &g_syncOpEOF;
+    packDirEntry(dir->pack->index, dir->pack->index.entries[dir->packNext++], out);
+    return &g_syncOp;
+  }
+  if (dir->next == dir->listed.size()) {
+    return &g_syncOpEOF;
+  }
+
+  hDir::Listed const& found = dir->listed[dir->next++];
+  hcrt::strncpy(out->filename, HART_ARRAYSIZE(out->filename), dir->names.c_str() + found.name);
+  out->typeFlags = found.typeFlags;
+  return &g_syncOp;
+}
+
+void closeDir(FileHandle dirhandle) {
+  delete static_cast<hDir*>(dirhandle);
+}
+
+// Only the aligned part of an aligned buffer at an aligned offset can skip the cache
+static void setDirectPart(FileOpAsync* op, FileHandle file) {
+  size_t mask = directAlignment() - 1;
+  if (file->directFd < 0 || (op->offset & mask) != 0 || ((uintptr_t)op->buffer & mask) != 0) return;
+  op->directFd = file->directFd;
+  op->directSize = op->size & ~mask;
+}
+
+FileOpHandle freadAsync(FileHandle file, void* buffer, size_t size, uint64_t offset) {
+  if (file->pack && !toArchiveRead(file, &offset, &size)) return &g_syncOpEOF;
+  auto* op = new FileOpAsync();
+  op->kind = AsyncOpKind::Read;
+  op->fd = file->fd;
+  op->buffer = (uint8_t*)buffer;
+  op->size = size;
+  op->offset = offset;
+  setDirectPart(op, file);
+  return submitAsync(op);
+}
+
+FileOpHandle fwriteAsync(FileHandle file, const void* buffer, size_t size, uint64_t offset) {
+  auto* op = new FileOpAsync();
+  op->kind = AsyncOpKind::Write;
+  op->fd = file->fd;
+  op->buffer = (uint8_t*)buffer;
+  op->size = size;
+  op->offset = offset;
+  setDirectPart(op, file);
+  return submitAsync(op);
+}
+
+FileOpHandle fstatAsync(FileHandle file, FileStat* out) {
+  // Answered from the pack's index
+  if (file->pack) {
+    out->filesize = file->packEntry->size;
+    out->modifiedDate = (time_t)file->packEntry->mtime;
+    return &g_syncOp;
+  }
+  auto* op = new FileOpAsync();
+  op->kind = AsyncOpKind::Stat;
+  op->fd = file->fd;
+  op->statOut = out;
+  return submitAsync(op);
+}
+
+// Reads are sorted by file and offset. Each run of back to back ranges becomes one vectored read, through the cache as
+// the ranges of a batch are rarely aligned. Files in a pack are sorted as ranges of the archive, so neighbouring files
+// read together are merged too.
+FileOpHandle freadAsyncBatch(ReadRequest const* in_reads, uint32_t count) {
+  if (count == 0) return &g_syncOp;
+  std::vector<ReadRequest> reads(in_reads, in_reads + count);
+  std::vector<uint32_t>    order;
+  Error                    result = Error::Ok;
+  order.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (reads[i].file->pack && !toArchiveRead(reads[i].file, &reads[i].offset, &reads[i].size)) {
+      result = Error::EndOfFile;
+      continue;
+    }
+    order.push_back(i);
+  }
+  if (order.empty()) return &g_syncOpEOF;
+  std::sort(order.begin(), order.end(), [&reads](uint32_t lhs, uint32_t rhs) {
+    int lfd = reads[lhs].file->fd, rfd = reads[rhs].file->fd;
+    return lfd != rfd ? lfd < rfd : reads[lhs].offset < reads[rhs].offset;
+  });
+
+  auto*                     batch = new FileOpAsync();
+  std::vector<FileOpAsync*> children;
+  batch->kind = AsyncOpKind::Batch;
+  batch->batchResult = result;
+  for (size_t i = 0, n = order.size(); i < n;) {
+    ReadRequest const& first = reads[order[i]];
+    auto*              op = new FileOpAsync();
+    op->kind = AsyncOpKind::Read;
+    op->fd = first.file->fd;
+    op->buffer = (uint8_t*)first.buffer;
+    op->size = first.size;
+    op->offset = first.offset;
+    op->batch = batch;
+    for (++i; i < n && op->segments.size() < IOV_MAX; ++i) {
+      ReadRequest const& next = reads[order[i]];
+      if (next.file->fd != op->fd || next.offset != op->offset + op->size) break;
+      if (op->segments.empty()) op->segments.push_back({first.buffer, first.size});
+      op->segments.push_back({next.buffer, next.size});
+      op->size += next.size;
+    }
+    children.push_back(op);
+  }
+
+  hScopedMutex sentry(&g_aio.access);
+  batch->remaining = (uint32_t)children.size();
+  for (auto* op : children)
+    submitLocked(op);
+  return batch;
+}
+
+struct MappedFile {
+  void*  base; // the view rounded down to a page
+  size_t length;
+};
+
+static int mapAdvice(MapHint hint) {
+  switch (hint) {
+  case MapHint::Sequential: return MADV_SEQUENTIAL;
+  case MapHint::Random: return MADV_RANDOM;
+  case MapHint::WillNeed: return MADV_WILLNEED;
+  default: return MADV_NORMAL;
+  }
+}
+
+bool mapFile(const char* filename, MappedView* out) {
+  return mapFile(filename, MapRange(), out);
+}
+
+// range is within the file_size bytes of fd from file_offset, all of it unless the file is in a pack
+static bool mapRange(int fd, uint64_t file_offset, uint64_t file_size, MapRange const& range, MappedView* out) {
+  // Can't map an empty range
+  if (range.offset >= file_size) return false;
+  uint64_t size = file_size - range.offset;
+  if (range.size && range.size < size) size = range.size;
+  uint64_t offset = file_offset + range.offset;
+  // mmap() offsets must be page aligned
+  uint64_t start = offset & ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+  size_t   length = (size_t)(size + offset - start);
+  // MAP_POPULATE reads the whole range in and fills the page tables before returning
+  void* base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | (range.prefault ? MAP_POPULATE : 0), fd, (off_t)start);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  if (range.hint != MapHint::Normal) madvise(base, length, mapAdvice(range.hint));
+
+  MappedFile* mf = new MappedFile();
+  mf->base = base;
+  mf->length = length;
+  out->data = (uint8_t const*)base + (offset - start);
+  out->size = size;
+  out->platform = mf;
+  return true;
+}
+
+bool mapFile(const char* filename, MapRange const& range, MappedView* out) {
+  PackEntry const* entry;
+  if (PackArchive* pack = findPackEntry(filename, &entry)) {
+    return entry && !(entry->flags & PackEntry_Dir) && mapRange(pack->fd, entry->offset, entry->size, range, out);
+  }
+
+  char path[HART_MAX_PATH];
+  getExpanedPath(filename, path, HART_MAX_PATH);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+
+  struct stat st;
+  bool        mapped = fstat(fd, &st) == 0 && mapRange(fd, 0, (uint64_t)st.st_size, range, out);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  return mapped;
+}
+
+void unmapFile(MappedView* view) {
+  MappedFile* mf = (MappedFile*)view->platform;
+  if (!mf) return;
+  munmap(mf->base, mf->length);
+  delete mf;
+  *view = MappedView();
+}
+
+void adviseMappedView(MappedView const* view, uint64_t offset, uint64_t size, MapHint hint) {
+  if (!view->platform || offset >= view->size) return;
+  if (!size || size > view->size - offset) size = view->size - offset;
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t)view->data + offset) & ~(page - 1);
+  uintptr_t end = (uintptr_t)view->data + offset + size;
+  madvise((void*)start, end - start, mapAdvice(hint));
+}
+
+struct SharedMapping {
+  size_t length;
+};
+
+static bool mapSharedMemory(int fd, size_t length, int prot, SharedMemory* out) {
+  void* data = mmap(nullptr, length, prot, MAP_SHARED, fd, 0);
+  // The mapping keeps its own reference to the memory
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  SharedMapping* sm = new SharedMapping();
+  sm->length = length;
+  out->data = data;
+  out->size = length;
+  out->platform = sm;
+  return true;
+}
+
+bool createSharedMemory(const char* name, uint64_t size, SharedMemory* out) {
+  char path[HART_MAX_PATH];
+  hcrt::sprintf(path, sizeof(path), "/%s", name);
+  int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) return false;
+  // Reserve the pages now, so running out of space fails here rather than faulting on the first write
+  if (size == 0 || posix_fallocate(fd, 0, (off_t)size) != 0) {
+    close(fd);
+    shm_unlink(path);
+    return false;
+  }
+  if (!mapSharedMemory(fd, size, PROT_READ | PROT_WRITE, out)) {
+    shm_unlink(path);
+    return false;
+  }
+  return true;
+}
+
+bool openSharedMemory(const char* name, SharedMemory* out) {
+  char path[HART_MAX_PATH];
+  hcrt::sprintf(path, sizeof(path), "/%s", name);
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0) return false;
+
+  struct stat st;
+  // Anyone can create a name, only trust our own. Empty while the creator is still sizing it
+  if (fstat(fd, &st) != 0 || st.st_uid != geteuid() || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  return mapSharedMemory(fd, st.st_size, PROT_READ, out);
+}
+
+void closeSharedMemory(SharedMemory* shm) {
+  SharedMapping* sm = (SharedMapping*)shm->platform;
+  if (!sm) return;
+  munmap(shm->data, sm->length);
+  delete sm;
+  *shm = SharedMemory();
+}
+
+void removeSharedMemory(const char* name) {
+  char path[HART_MAX_PATH];
+  hcrt::sprintf(path, sizeof(path), "/%s", name);
+  shm_unlink(path);
+}
+
+static const uint32_t watchDirMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+
+// rel is empty or ends with '/'. Files found in a directory created after the watch started are reported as changed,
+// as they may have been written before the directory's watch was added.
+static void addWatchTree(Watch* watch, std::string const& rel, bool report_files) {
+  std::string path = watch->root + rel;
+  int         wd = inotify_add_watch(watch->fd, path.c_str(), watchDirMask);
+  if (wd < 0) return;
+  watch->dirs[wd] = rel;
+
+  DIR* dir = opendir(path.c_str());
+  if (!dir) return;
+  while (dirent* found = readdir(dir)) {
+    if (hcrt::strcmp(found->d_name, ".") == 0 || hcrt::strcmp(found->d_name, "..") == 0) continue;
+    if (found->d_type == DT_DIR) {
+      addWatchTree(watch, rel + found->d_name + "/", report_files);
+    } else if (report_files) {
+      watch->changed.push_back(rel + found->d_name);
+    }
+  }
+  closedir(dir);
+}
+
+WatchHandle watchDirectory(const char* path) {
+  // Packs never change
+  PackEntry const* entry;
+  if (findPackEntry(path, &entry)) return nullptr;
+
+  char native[HART_MAX_PATH];
+  getExpanedPath(path, native, HART_MAX_PATH);
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) return nullptr;
+
+  auto* watch = new Watch();
+  watch->fd = fd;
+  watch->root = native;
+  if (watch->root.empty() || watch->root.back() != '/') watch->root += '/';
+  addWatchTree(watch, std::string(), false);
+  if (watch->dirs.empty()) {
+    closeWatch(watch);
+    return nullptr;
+  }
+  return watch;
+}
+
+static void readWatchEvents(Watch* watch) {
+  alignas(inotify_event) char buf[16 * 1024];
+  for (;;) {
+    ssize_t len = read(watch->fd, buf, sizeof(buf));
+    if (len < 0 && errno == EINTR) continue;
+    if (len <= 0) return;
+    for (char const* ptr = buf; ptr < buf + len;) {
+      auto const* ev = (inotify_event const*)ptr;
+      ptr += sizeof(inotify_event) + ev->len;
+      auto dir = watch->dirs.find(ev->wd);
+      if (ev->mask & IN_IGNORED) {
+        watch->dirs.erase(ev->wd);
+        continue;
+      }
+      if (dir == watch->dirs.end() || !ev->len) continue;
+      std::string rel = dir->second + ev->name;
+      if (ev->mask & IN_ISDIR) {
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) addWatchTree(watch, rel + "/", true);
+      } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        // IN_CREATE alone isn't reported, the file isn't written yet
+        watch->changed.push_back(rel);
+      }
+    }
+  }
+}
+
+bool readWatch(WatchHandle watch, DirEntry* out) {
+  if (watch->nextChanged == watch->changed.size()) {
+    watch->changed.clear();
+    watch->nextChanged = 0;
+    readWatchEvents(watch);
+    if (watch->changed.empty()) return false;
+  }
+
+  hcrt::strcpy(out->filename, HART_ARRAYSIZE(out->filename), watch->changed[watch->nextChanged++].c_str());
+  out->typeFlags = (uint32_t)FileEntryType::File;
+  return true;
+}
+
+void closeWatch(WatchHandle watch) {
+  if (watch && watch->fd >= 0) {
+    close(watch->fd);
+  }
+  delete watch;
+}
+
+bool isAbsolutePath(const char* path) {
+  if (!path) {
+    return false;
+  }
+  return path[0] == '/';
+}
+
+// path must be a native path, it isn't expanded through the existing mounts
+void mountPoint(const char* path, const char* mount) {
+  hScopedMutex sentry(&g_mountMtx);
+  hdbassert(isAbsolutePath(mount), "Path is not absolute");
+  hdbassert(isAbsolutePath(path), "Mount point is not absolute");
+  MountTable const*  table = hatomic::atomicGet(g_mountTable);
+  std::vector<Mount> mounts;
+  if (table) mounts = table->mounts;
+  Mount mnt;
+  mnt.mountName = mount;
+  mnt.mountPoint = path;
+  mounts.push_back(mnt);
+  publishMountTable(std::move(mounts));
+}
+
+void unmountPoint(const char* mount) {
+  hScopedMutex       sentry(&g_mountMtx);
+  MountTable const*  table = hatomic::atomicGet(g_mountTable);
+  std::vector<Mount> mounts;
+  if (table) mounts = table->mounts;
+  mounts.erase(std::remove_if(mounts.begin(), mounts.end(),
+                              [=](const Mount& rhs) { return hcrt::strcmp(mount, rhs.mountName.c_str()) == 0; }),
+               mounts.end());
+  publishMountTable(std::move(mounts));
+}
+
+static bool readAll(int fd, void* buffer, size_t size, uint64_t offset) {
+  for (size_t done = 0; done < size;) {
+    ssize_t r = pread(fd, (uint8_t*)buffer + done, size - done, (off_t)(offset + done));
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    done += r;
+  }
+  return true;
+}
+
+bool mountPack(const char* pack_path, const char* mount) {
+  hScopedMutex sentry(&g_mountMtx);
+  hdbassert(isAbsolutePath(mount), "Path is not absolute");
+  PackEntry const* entry;
+  if (findPackEntry(pack_path, &entry)) return false;
+  char path[HART_MAX_PATH];
+  getExpanedPath(pack_path, path, HART_MAX_PATH);
+  std::unique_ptr<PackArchive> pack(new PackArchive());
+  pack->fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  PackHeader  header;
+  if (pack->fd < 0 || fstat(pack->fd, &st) != 0 || !readAll(pack->fd, &header, sizeof(header), 0) ||
+      PackIndex::indexSize(header) > (uint64_t)st.st_size) {
+    return false;
+  }
+  std::vector<uint8_t> index((size_t)PackIndex::indexSize(header));
+  if (!readAll(pack->fd, index.data(), index.size(), 0) || !pack->index.load(index.data(), (uint64_t)st.st_size)) {
+    return false;
+  }
+
+  MountTable const*  table = hatomic::atomicGet(g_mountTable);
+  std::vector<Mount> mounts;
+  if (table) mounts = table->mounts;
+  Mount mnt;
+  mnt.mountName = mount;
+  mnt.mountPoint = path;
+  mnt.pack = pack.get();
+  mounts.push_back(mnt);
+  g_packArchives.push_back(std::move(pack));
+  publishMountTable(std::move(mounts));
+  return true;
+}
+
+void getCurrentWorkingDir(char* out, uint32_t bufsize) {
+  if (!getcwd(out, bufsize - 1)) {
+    out[0] = 0;
+    return;
+  }
+  size_t len = hcrt::strlen(out);
+  if (len == 0 || out[len - 1] != '/') {
+    out[len] = '/';
+    out[len + 1] = 0;
+  }
+}
+
+void getProcessDirectory(char* outdir, uint32_t size) {
+  ssize_t len = readlink("/proc/self/exe", outdir, size - 1);
+  if (len < 0) {
+    outdir[0] = 0;
+    return;
+  }
+  outdir[len] = 0;
+  auto* s = strrchr(outdir, '/');
+  if (s) {
+    *(s + 1) = 0;
+  }
+}
+}
+}
@@ -0,0 +1,49 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file LICENSE.txt in the repository root directory.
+*********************************************************************/
+#include "hart/base/thread.h"
+#include "hart/base/debug.h"
+#include "hart/base/threadlocalstorage.h"
+
+namespace hart {
+
+Thread::Thread() : threadFunc(nullptr) {}
+
+Thread::~Thread() {
+  delete threadFunc;
+}
+
+void Thread::create(const char* threadName, int32_t priority, Function pFunctor, void* param) {
+  hcrt::strncpy(threadName_, THREAD_NAME_SIZE - 1, threadName);
+  threadName_[THREAD_NAME_SIZE - 1] = 0;
+  threadFunc = new Function(pFunctor);
+  pThreadParam_ = param;
+  priority_ = priority;
+  if (priority_ < -2) {
+    priority_ = -2;
+  }
+  if (priority_ > 2) {
+    priority_ = 2;
+  }
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, (1024 * 1024) * 2);
+  int r = pthread_create(&threadHand_, &attr, staticFunc, this);
+  hdbassert(r == 0, "pthread_create Failed");
+  pthread_attr_destroy(&attr);
+}
+
+void* Thread::staticFunc(void* pParam) {
+  Thread* local_this = (Thread*)pParam;
+  // Names are limited to 15 characters. Changing the priority of a normal thread needs privileges, so it's left as is
+  char name[16];
+  hcrt::strncpy(name, sizeof(name) - 1, local_this->threadName_);
+  name[sizeof(name) - 1] = 0;
+  pthread_setname_np(pthread_self(), name);
+  hprofile_namethread(local_this->threadName_);
+  local_this->returnCode_ = (*local_this->threadFunc)(local_this->pThreadParam_);
+  // TLS destructors are run by pthreads on exit
+  return nullptr;
+}
+}
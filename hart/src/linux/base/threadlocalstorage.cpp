@@ -0,0 +1,31 @@
+/********************************************************************
+    Written by James Moran
+    Please see the file HEART_LICENSE.txt in the source's root directory.
+*********************************************************************/
+#include "hart/base/threadlocalstorage.h"
+#include "hart/base/debug.h"
+#include <pthread.h>
+
+namespace hart {
+namespace tls {
+
+size_t createKey(KeyDestructor destructor) {
+  pthread_key_t key;
+  int           r = pthread_key_create(&key, destructor);
+  hdbassert(r == 0, "pthread_key_create Failed");
+  return (size_t)key;
+}
+
+void deleteKey(size_t key) {
+  pthread_key_delete((pthread_key_t)key);
+}
+
+void setKeyValue(size_t key, void* value) {
+  pthread_setspecific((pthread_key_t)key, value);
+}
+
+void* getKeyValue(size_t key) {
+  return pthread_getspecific((pthread_key_t)key);
+}
+}
+}
@@ -1,28 +1,76 @@
 
 #include "hart/config.h"
 #include "hart/base/mutex.h"
+#include "hart/base/semaphore.h"
 #include "hart/core/utf8.h"
 #include "hart/base/filesystem.h"
+#include "hart/base/pack.h"
 #include "hart/base/util.h"
 #include "hart/base/crt.h"
 #include "hart/base/debug.h"
+#include "hart/base/atomic.h"
 #include <windows.h>
 #include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
 #include <algorithm>
 
 namespace hart {
 namespace filesystem {
 
+// Mounted with mountPack(). Open until exit, as old mount tables and open files may still use it once unmounted.
+struct PackArchive {
+  ~PackArchive() {
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+  }
+
+  HANDLE    fileHandle = INVALID_HANDLE_VALUE; // overlapped
+  PackIndex index;
+};
+
 struct File {
   HANDLE fileHandle;
+  HANDLE directHandle = INVALID_HANDLE_VALUE; // FILE_FLAG_NO_BUFFERING, when opened with OpenFlag_Direct
+  // Files and directories in a pack, fileHandle is the archive's
+  PackArchive*     pack = nullptr;
+  PackEntry const* packEntry = nullptr;
 };
 
+// Listed in full by openDir() on the thread pool, readDir() hands the entries out from memory
 struct hDir : File {
-  DirEntry currentEntry;
+  struct Listed {
+    uint32_t name; // into names, terminated
+    uint32_t typeFlags;
+  };
+  std::string         names;
+  std::vector<Listed> listed;
+  size_t              next = 0;
+  uint32_t            packNext = 0; // entries of a pack directory left to read
+  uint32_t            packEnd = 0;
 };
 
+struct FileOpBatch;
+struct FileOpMeta;
+
 struct FileOp {
   virtual ~FileOp() {}
+  virtual FileOpBatch* asBatch() { return nullptr; }
+  virtual FileOpMeta*  asMeta() { return nullptr; }
+};
+
+// Each read is issued on its own. Merging adjacent ranges would need ReadFileScatter, which only takes unbuffered,
+// page sized buffers.
+struct FileOpBatch : FileOp {
+  FileOpBatch* asBatch() override { return this; }
+
+  std::vector<FileOpHandle> reads; // nullptr once complete
+  Error                     result = Error::Ok;
+  // A direct read or write split into its aligned head and the rest. Like any other read it's only at the end of the
+  // file when it starts there, which is when both parts are.
+  bool     split = false;
+  uint32_t partsAtEnd = 0;
 };
 
 struct FileOpRW : FileOp {
@@ -35,45 +83,168 @@ struct FileOpRW : FileOp {
   OVERLAPPED operation;
 };
 
+// Opens, stats and directory listings have no overlapped form, they're run on the system thread pool instead. done is
+// set once work has returned its result.
+struct FileOpMeta : FileOp {
+  FileOpMeta() { done = CreateEvent(nullptr, TRUE, FALSE, nullptr); }
+  ~FileOpMeta() { CloseHandle(done); }
+  FileOpMeta* asMeta() override { return this; }
+
+  std::function<Error()> work;
+  HANDLE                 done;
+  Error                  result = Error::Pending;
+};
+
+static DWORD WINAPI runMetaOp(LPVOID param) {
+  auto* op = (FileOpMeta*)param;
+  op->result = op->work();
+  SetEvent(op->done);
+  return 0;
+}
+
+static FileOpHandle queueMetaOp(std::function<Error()> work) {
+  auto* op = new FileOpMeta();
+  op->work = std::move(work);
+  if (!QueueUserWorkItem(runMetaOp, op, WT_EXECUTEDEFAULT)) runMetaOp(op);
+  return op;
+}
+
+static DWORD WINAPI closeHandleWork(LPVOID handle) {
+  CloseHandle((HANDLE)handle);
+  return 0;
+}
+
+static void queueClose(HANDLE handle) {
+  if (handle == INVALID_HANDLE_VALUE) return;
+  if (!QueueUserWorkItem(closeHandleWork, handle, WT_EXECUTEDEFAULT)) CloseHandle(handle);
+}
+
 struct Mount {
-  std::string mountName;
-  std::string mountPoint;
+  std::string  mountName;
+  std::string  mountPoint;
+  PackArchive* pack = nullptr; // serves the mount instead of mountPoint
+};
+
+// Mount names compiled into a radix trie, so finding the longest matching name is one compare per mount along the
+// way. Tables are never changed once published, which lets paths expand without taking g_mountMtx.
+struct MountTable {
+  struct Node {
+    char     first; // labels[label]
+    uint32_t label;
+    uint32_t labelLen;
+    uint32_t firstChild;
+    uint32_t childCount;
+    int32_t  mount; // ending here, or -1
+  };
+  std::vector<Mount> mounts; // in the order they were mounted
+  std::vector<Node>  nodes;  // nodes[0] is the root, each node's children are contiguous
+  std::string        labels;
+};
+
+struct Watch {
+  HANDLE                   dirHandle;
+  OVERLAPPED               operation;
+  DWORD                    buffer[16 * 1024]; // FILE_NOTIFY_INFORMATION must be DWORD aligned
+  std::vector<std::string> changed;
+  size_t                   nextChanged = 0;
 };
 
 // Dummy op to return if operation completes immediately
-FileOp             g_syncOp;
-FileOp             g_syncOpEOF;
-std::vector<Mount> g_mounts;
-hMutex             g_mountMtx;
+FileOp                      g_syncOp;
+FileOp                      g_syncOpEOF;
+FileOp                      g_syncOpFailed; // failed before anything was issued, e.g. opening a file a pack hasn't got
+hMutex                      g_mountMtx; // serialises changes to the mounts
+hatomic::aptr_t<MountTable> g_mountTable;
+// Every table published, as a reader may still be using an old one. Mounts change a handful of times a run.
+std::vector<std::unique_ptr<MountTable>> g_mountTables;
+std::vector<std::unique_ptr<PackArchive>> g_packArchives; // every pack mounted, under g_mountMtx
 
 static bool isAbsPath(const char* in_path) {
   return (in_path[0] != '\0' && in_path[1] == ':' && in_path[2] == '\\');
 }
 
-static void getExpanedPath(const char* in_path, char* out_path, size_t max_len) {
-  hScopedMutex sentry(&g_mountMtx);
-  hcrt::strcpy(out_path, HART_MAX_PATH, in_path);
-  do {
-    size_t offset = 0;
-    for (const auto& mnt : g_mounts) {
-      if (hcrt::strncmp(mnt.mountName.c_str(), out_path, mnt.mountName.size()) == 0) {
-        offset = mnt.mountName.size();
-        auto plen = mnt.mountPoint.size();
-        auto slen = hcrt::strlen(out_path);
-        if ((plen + slen + 1) > HART_MAX_PATH) {
-          plen = HART_MAX_PATH - slen;
-        }
-        hcrt::memmove(out_path + plen, out_path + offset, (slen - offset) + 1);
-        hcrt::strncpy(out_path, plen, mnt.mountPoint.c_str());
-        break;
+// The first mounted of any with the same name wins, as it did when mounts were searched in order
+static void publishMountTable(std::vector<Mount> mounts) {
+  std::unique_ptr<MountTable>           table(new MountTable());
+  std::vector<std::map<char, uint32_t>> children(1);
+  std::vector<int32_t>                  ends(1, -1);
+  for (size_t i = 0, n = mounts.size(); i < n; ++i) {
+    uint32_t node = 0;
+    for (char c : mounts[i].mountName) {
+      auto it = children[node].find(c);
+      if (it != children[node].end()) {
+        node = it->second;
+        continue;
+      }
+      uint32_t child = (uint32_t)children.size();
+      children[node].emplace(c, child);
+      children.emplace_back();
+      ends.push_back(-1);
+      node = child;
+    }
+    if (ends[node] < 0) ends[node] = (int32_t)i;
+  }
+  // Flatten breadth first, merging runs of nodes with one child and no mount into a single label
+  std::vector<uint32_t> from(1, 0); // byte trie node each table node ends at
+  table->nodes.push_back({0, 0, 0, 0, 0, ends[0]});
+  for (size_t i = 0; i < table->nodes.size(); ++i) {
+    table->nodes[i].firstChild = (uint32_t)table->nodes.size();
+    table->nodes[i].childCount = (uint32_t)children[from[i]].size();
+    for (auto const& edge : children[from[i]]) {
+      MountTable::Node child = {edge.first, (uint32_t)table->labels.size(), 1, 0, 0, -1};
+      uint32_t         node = edge.second;
+      table->labels.push_back(edge.first);
+      for (; ends[node] < 0 && children[node].size() == 1; ++child.labelLen) {
+        table->labels.push_back(children[node].begin()->first);
+        node = children[node].begin()->second;
       }
+      child.mount = ends[node];
+      table->nodes.push_back(child);
+      from.push_back(node);
     }
-  } while (!isAbsPath(out_path) && hcrt::strcmp(in_path, out_path) != 0);
+  }
+  table->mounts = std::move(mounts);
+  hatomic::atomicSet(g_mountTable, table.get());
+  g_mountTables.push_back(std::move(table));
+}
+
+// Longest mount name path starts with
+static Mount const* findMount(MountTable const* table, const char* path, size_t* name_len) {
+  Mount const*            found = nullptr;
+  MountTable::Node const* node = table->nodes.data();
+  for (size_t i = 0;;) {
+    if (node->mount >= 0) {
+      found = &table->mounts[node->mount];
+      *name_len = i;
+    }
+    MountTable::Node const* child = table->nodes.data() + node->firstChild;
+    MountTable::Node const* last = child + node->childCount;
+    while (child != last && child->first != path[i])
+      ++child;
+    if (child == last || hcrt::strncmp(table->labels.c_str() + child->label, path + i, child->labelLen) != 0)
+      return found;
+    i += child->labelLen;
+    node = child;
+  }
+}
+
+// Mount points are expanded to native paths as they're mounted, so expanding is a single lookup in the mount table
+static void getExpanedPath(const char* in_path, char* out_path, size_t max_len) {
+  MountTable const* table = hatomic::atomicGet(g_mountTable);
+  size_t            offset = 0;
+  Mount const*      mnt = table ? findMount(table, in_path, &offset) : nullptr;
+  size_t            slen = hcrt::strlen(in_path);
+  size_t            plen = mnt ? mnt->mountPoint.size() : 0;
+  if (!mnt || (plen + slen - offset + 1) > max_len) {
+    hcrt::strcpy(out_path, max_len, in_path);
+    return;
+  }
+  hcrt::memcpy(out_path, mnt->mountPoint.c_str(), plen);
+  hcrt::memcpy(out_path + plen, in_path + offset, (slen - offset) + 1);
 }
 
 static size_t getExpanedPathUC2(const char* in_path, wchar_t* out_path, size_t max_len) {
-  hScopedMutex sentry(&g_mountMtx);
-  char         expaned[HART_MAX_PATH] = {0};
+  char expaned[HART_MAX_PATH] = {0};
   getExpanedPath(in_path, expaned, HART_MAX_PATH);
   return hutf8::utf8_to_uc2(expaned, (uint16_t*)out_path, max_len);
 }
@@ -83,6 +254,29 @@ static size_t getExpanedPathUC2(const char* in_path, wchar_t (&out_path)[t_array
   return getExpanedPathUC2(in_path, out_path, t_array_size);
 }
 
+// The pack mounted over path and the entry path names in it, which is null if there's none. Null if path isn't under a
+// pack mount, pack mount points aren't native paths so getExpanedPath() is no use for them.
+static PackArchive* findPackEntry(const char* path, PackEntry const** out_entry) {
+  MountTable const* table = hatomic::atomicGet(g_mountTable);
+  size_t            offset = 0;
+  Mount const*      mnt = table ? findMount(table, path, &offset) : nullptr;
+  if (!mnt || !mnt->pack) return nullptr;
+  *out_entry = mnt->pack->index.find(path + offset);
+  return mnt->pack;
+}
+
+// Reads of a file in a pack are reads of the archive, cut short at the end of the file. False when starting past it.
+static bool toArchiveRead(File const* file, uint64_t* offset, size_t* size) {
+  PackEntry const* entry = file->packEntry;
+  if (*offset >= entry->size) {
+    if (*size) return false;
+  } else if (*size > entry->size - *offset) {
+    *size = (size_t)(entry->size - *offset);
+  }
+  *offset += entry->offset;
+  return true;
+}
+
 void mountPoint(const char* path, const char* mount);
 void getCurrentWorkingDir(char* out, uint32_t bufsize);
 
@@ -94,13 +288,48 @@ bool initialise_filesystem() {
 }
 
 void fileOpClose(FileOpHandle in_op) {
-  if (&g_syncOp == in_op || &g_syncOpEOF == in_op || !in_op) {
+  if (&g_syncOp == in_op || &g_syncOpEOF == in_op || &g_syncOpFailed == in_op || !in_op) {
     return;
   }
 
   delete in_op;
 }
 
+Error fileOpComplete(FileOpHandle in_op);
+Error fileOpWait(FileOpHandle in_op);
+
+static void mergeBatchResult(FileOpBatch* batch, Error er) {
+  if (batch->split && er == Error::EndOfFile && ++batch->partsAtEnd < 2) return;
+  if (er == Error::Failed || (er == Error::EndOfFile && batch->result == Error::Ok)) {
+    batch->result = er;
+  }
+}
+
+static Error batchComplete(FileOpBatch* batch, bool wait) {
+  bool pending = false;
+  for (auto& read : batch->reads) {
+    if (!read) continue;
+    Error er = wait ? fileOpWait(read) : fileOpComplete(read);
+    if (er == Error::Pending) {
+      pending = true;
+      continue;
+    }
+    mergeBatchResult(batch, er);
+    read = nullptr;
+  }
+  if (pending) return Error::Pending;
+  Error er = batch->result;
+  delete batch;
+  return er;
+}
+
+static Error metaComplete(FileOpMeta* op, bool wait) {
+  if (WaitForSingleObject(op->done, wait ? INFINITE : 0) != WAIT_OBJECT_0) return Error::Pending;
+  Error er = op->result;
+  delete op;
+  return er;
+}
+
 Error fileOpComplete(FileOpHandle in_op) {
   if (&g_syncOp == in_op) {
     return Error::Ok;
@@ -108,6 +337,15 @@ Error fileOpComplete(FileOpHandle in_op) {
   if (&g_syncOpEOF == in_op) {
     return Error::EndOfFile;
   }
+  if (&g_syncOpFailed == in_op || !in_op) {
+    return Error::Failed;
+  }
+  if (FileOpBatch* batch = in_op->asBatch()) {
+    return batchComplete(batch, false);
+  }
+  if (FileOpMeta* meta = in_op->asMeta()) {
+    return metaComplete(meta, false);
+  }
 
   auto* op = static_cast<FileOpRW*>(in_op);
   DWORD xferred;
@@ -130,7 +368,7 @@ Error fileOpComplete(FileOpHandle in_op) {
 }
 
 Error fileOpWait(FileOpHandle in_op) {
-  if (in_op == nullptr) {
+  if (&g_syncOpFailed == in_op || in_op == nullptr) {
     return Error::Failed;
   }
   if (&g_syncOp == in_op) {
@@ -139,6 +377,12 @@ Error fileOpWait(FileOpHandle in_op) {
   if (&g_syncOpEOF == in_op) {
     return Error::EndOfFile;
   }
+  if (FileOpBatch* batch = in_op->asBatch()) {
+    return batchComplete(batch, true);
+  }
+  if (FileOpMeta* meta = in_op->asMeta()) {
+    return metaComplete(meta, true);
+  }
 
   auto* op = static_cast<FileOpRW*>(in_op);
   DWORD xferred;
@@ -151,13 +395,135 @@ Error fileOpWait(FileOpHandle in_op) {
   return Error::Ok;
 }
 
-FileOpHandle openFile(const char* filename, Mode mode, FileHandle* outhandle) {
+struct CompletionQueue {
+  hMutex                  access;
+  std::vector<Completion> ready;
+  hSemaphore              available; // posted once per completion in ready
+};
+
+// Waited on by the system thread pool, one wait per overlapped event. Holds one extra reference while the waits are
+// registered so one firing early can't free it.
+struct PostedOp {
+  FileOpHandle        op;
+  CompletionQueue*    queue;
+  CompletionCallback  callback;
+  void*               userData;
+  std::vector<HANDLE> waits;
+  volatile LONG       remaining;
+};
+
+static void postCompletion(CompletionQueue* queue, CompletionCallback callback, Completion const& completion) {
+  if (queue) {
+    hScopedMutex sentry(&queue->access);
+    queue->ready.push_back(completion);
+    queue->available.Post();
+  }
+  if (callback) callback(completion);
+}
+
+static VOID CALLBACK onPostedEvent(PVOID param, BOOLEAN) {
+  auto* posted = (PostedOp*)param;
+  if (InterlockedDecrement(&posted->remaining) != 0) return;
+  for (HANDLE wait : posted->waits) {
+    if (wait) UnregisterWaitEx(wait, nullptr);
+  }
+  // Every event is set, so this doesn't block
+  Completion completion = {posted->op, fileOpWait(posted->op), posted->userData};
+  postCompletion(posted->queue, posted->callback, completion);
+  delete posted;
+}
+
+CompletionQueueHandle createCompletionQueue() {
+  auto* queue = new CompletionQueue();
+  queue->available.Create(0, INT32_MAX);
+  return queue;
+}
+
+void destroyCompletionQueue(CompletionQueueHandle queue) {
+  if (!queue) return;
+  queue->available.Destroy();
+  delete queue;
+}
+
+void fileOpPost(FileOpHandle op, CompletionQueueHandle queue, void* user_data, CompletionCallback callback) {
+  if (&g_syncOp == op || &g_syncOpEOF == op || &g_syncOpFailed == op || !op) {
+    postCompletion(queue, callback, {op, fileOpWait(op), user_data});
+    return;
+  }
+
+  std::vector<HANDLE> events;
+  if (FileOpBatch* batch = op->asBatch()) {
+    for (auto read : batch->reads) {
+      if (read) events.push_back(static_cast<FileOpRW*>(read)->operation.hEvent);
+    }
+  } else if (FileOpMeta* meta = op->asMeta()) {
+    events.push_back(meta->done);
+  } else {
+    events.push_back(static_cast<FileOpRW*>(op)->operation.hEvent);
+  }
+  auto* posted = new PostedOp();
+  posted->op = op;
+  posted->queue = queue;
+  posted->callback = callback;
+  posted->userData = user_data;
+  posted->waits.resize(events.size());
+  posted->remaining = (LONG)events.size() + 1;
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (!RegisterWaitForSingleObject(&posted->waits[i], events[i], onPostedEvent, posted, INFINITE,
+                                     WT_EXECUTEONLYONCE)) {
+      posted->waits[i] = nullptr;
+      onPostedEvent(posted, FALSE);
+    }
+  }
+  onPostedEvent(posted, FALSE);
+}
+
+// Takes one completion per post of available, so a waiter that has already taken its post always finds one
+static uint32_t takeCompletions(CompletionQueue* queue, Completion* out, uint32_t max, uint32_t taken) {
+  hScopedMutex sentry(&queue->access);
+  uint32_t     n = taken;
+  while (n < max && n < queue->ready.size() && queue->available.poll())
+    ++n;
+  std::copy(queue->ready.begin(), queue->ready.begin() + n, out);
+  queue->ready.erase(queue->ready.begin(), queue->ready.begin() + n);
+  return n;
+}
+
+uint32_t popCompletions(CompletionQueueHandle queue, Completion* out, uint32_t max) {
+  return takeCompletions(queue, out, max, 0);
+}
+
+uint32_t waitCompletions(CompletionQueueHandle queue, Completion* out, uint32_t max) {
+  if (max == 0) return 0;
+  queue->available.Wait();
+  return takeCompletions(queue, out, max, 1);
+}
+
+// Packs are read only, and their files always go through the cache
+static FileOpHandle openPackFile(PackArchive* pack, PackEntry const* entry, Mode mode, FileHandle* outhandle) {
+  if (!entry || (entry->flags & PackEntry_Dir) || mode != Mode::Read) {
+    (*outhandle) = nullptr;
+    return &g_syncOpFailed;
+  }
+
+  (*outhandle) = new File();
+  (*outhandle)->fileHandle = pack->fileHandle;
+  (*outhandle)->pack = pack;
+  (*outhandle)->packEntry = entry;
+  return &g_syncOp;
+}
+
+FileOpHandle openFile(const char* filename, Mode mode, FileHandle* outhandle, uint32_t open_flags) {
+  PackEntry const* entry;
+  if (PackArchive* pack = findPackEntry(filename, &entry)) {
+    return openPackFile(pack, entry, mode, outhandle);
+  }
+
   DWORD                 access = 0;
   DWORD                 share = FILE_SHARE_READ | FILE_SHARE_WRITE; //< Should this be zero in non-debug builds?
   LPSECURITY_ATTRIBUTES secatt = NULL;                              // could be a prob if passed across threads>?
   DWORD                 creation = 0;
   DWORD                 flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED;
-  HANDLE                fhandle;
 
   if (mode == Mode::Read) {
     access = GENERIC_READ;
@@ -169,87 +535,147 @@ FileOpHandle openFile(const char* filename, Mode mode, FileHandle* outhandle) {
 
   wchar_t filename_wide[HART_MAX_PATH];
   getExpanedPathUC2(filename, filename_wide);
-  fhandle = CreateFileW(filename_wide, access, share, secatt, creation, flags, nullptr);
+  std::wstring path = filename_wide;
+  // outhandle is written once the open is done
+  return queueMetaOp([=]() {
+    HANDLE fhandle = CreateFileW(path.c_str(), access, share, secatt, creation, flags, nullptr);
+    if (fhandle == INVALID_HANDLE_VALUE) {
+      (*outhandle) = nullptr;
+      return Error::Failed;
+    }
 
-  if (fhandle == INVALID_HANDLE_VALUE) {
-    (*outhandle) = nullptr;
-    return nullptr;
-  }
+    auto* file = new File();
+    file->fileHandle = fhandle;
+    // A second handle so unaligned parts can still go through the cache
+    if (open_flags & OpenFlag_Direct) {
+      file->directHandle =
+        CreateFileW(path.c_str(), access, share, secatt, OPEN_EXISTING, flags | FILE_FLAG_NO_BUFFERING, nullptr);
+    }
+    (*outhandle) = file;
+    return Error::Ok;
+  });
+}
 
-  (*outhandle) = new File();
-  (*outhandle)->fileHandle = fhandle;
+// The handles are closed in the background, nothing waits on it
+void closeFile(FileHandle handle) {
+  if (!handle) return;
+  if (!handle->pack) queueClose(handle->fileHandle);
+  queueClose(handle->directHandle);
+  delete handle;
+}
 
-  return &g_syncOp;
+// Covers drives with 512 byte and 4KB sectors
+size_t directAlignment() {
+  return 4096;
 }
 
-void closeFile(FileHandle handle) {
-  if (handle && handle->fileHandle != INVALID_HANDLE_VALUE) {
-    CloseHandle(handle->fileHandle);
-  }
+void* allocDirectBuffer(size_t size) {
+  size_t alignment = directAlignment();
+  return hcrt::alignedMalloc((size + alignment - 1) & ~(alignment - 1), alignment);
+}
 
-  delete handle;
+void freeDirectBuffer(void* buffer) {
+  hcrt::alignedFree(buffer);
 }
 
-FileOpHandle openDir(const char* path, FileHandle* outhandle) {
-  WIN32_FIND_DATAW found;
-  auto*            dir = new hDir();
-  wchar_t          path_wide[HART_MAX_PATH];
-  getExpanedPathUC2(path, path_wide);
-  dir->fileHandle = FindFirstFileW(path_wide, &found);
-  // Heart::hStrCopy(dir->currentEntry.filename, HART_MAX_PATH, found.cFileName);
-  hutf8::uc2_to_utf8((uint16_t*)found.cFileName, dir->currentEntry.filename,
-                     HART_ARRAYSIZE(dir->currentEntry.filename));
-  dir->currentEntry.typeFlags = 0;
+static void packDirEntry(PackIndex const& index, PackEntry const& entry, DirEntry* out) {
+  index.getName(entry, out->filename, HART_ARRAYSIZE(out->filename));
+  out->typeFlags = (uint32_t)(entry.flags & PackEntry_Dir ? FileEntryType::Dir : FileEntryType::File);
+}
+
+static FileOpHandle openPackDir(PackArchive* pack, PackEntry const* entry, FileHandle* outhandle) {
+  auto* dir = new hDir();
+  dir->fileHandle = INVALID_HANDLE_VALUE;
+  dir->pack = pack;
+  if (entry && (entry->flags & PackEntry_Dir)) {
+    dir->packNext = entry->firstChild;
+    dir->packEnd = entry->firstChild + entry->childCount;
+  }
+  *outhandle = dir;
+  return &g_syncOp;
+}
+
+static uint32_t findDataType(WIN32_FIND_DATAW const& found) {
+  uint32_t type_flags = 0;
   if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-    dir->currentEntry.typeFlags |= (uint32_t)FileEntryType::Dir;
+    type_flags |= (uint32_t)FileEntryType::Dir;
   } else {
-    dir->currentEntry.typeFlags |= (uint32_t)FileEntryType::File;
+    type_flags |= (uint32_t)FileEntryType::File;
   }
   if (found.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
-    dir->currentEntry.typeFlags |= (uint32_t)FileEntryType::SymLink;
+    type_flags |= (uint32_t)FileEntryType::SymLink;
   }
-  *outhandle = dir;
-  return &g_syncOp;
+  return type_flags;
+}
+
+// A search that matches nothing lists as empty
+static void listDir(hDir* dir, const wchar_t* search) {
+  WIN32_FIND_DATAW found;
+  HANDLE           find = FindFirstFileW(search, &found);
+  if (find == INVALID_HANDLE_VALUE) return;
+  do {
+    char filename[HART_MAX_PATH];
+    hutf8::uc2_to_utf8((uint16_t*)found.cFileName, filename, HART_ARRAYSIZE(filename));
+    dir->listed.push_back({(uint32_t)dir->names.size(), findDataType(found)});
+    dir->names.append(filename, hcrt::strlen(filename) + 1);
+  } while (FindNextFileW(find, &found));
+  FindClose(find);
+}
+
+FileOpHandle openDir(const char* path, FileHandle* outhandle) {
+  // A pack directory lists its entries in name order, without "." and "..". Of search patterns only a trailing '*' is
+  // understood.
+  char pattern[HART_MAX_PATH];
+  hcrt::strcpy(pattern, HART_MAX_PATH, path);
+  size_t len = hcrt::strlen(pattern);
+  if (len && pattern[len - 1] == '*') {
+    pattern[len - 1] = 0;
+  }
+  PackEntry const* entry;
+  if (PackArchive* pack = findPackEntry(pattern, &entry)) {
+    return openPackDir(pack, entry, outhandle);
+  }
+
+  auto*   dir = new hDir();
+  wchar_t path_wide[HART_MAX_PATH];
+  getExpanedPathUC2(path, path_wide);
+  dir->fileHandle = INVALID_HANDLE_VALUE;
+  std::wstring search = path_wide;
+  return queueMetaOp([=]() {
+    listDir(dir, search.c_str());
+    *outhandle = dir;
+    return Error::Ok;
+  });
 }
 
 FileOpHandle readDir(FileHandle dirhandle, DirEntry* out) {
   auto* dir = static_cast<hDir*>(dirhandle);
-  if (dir->fileHandle == INVALID_HANDLE_VALUE) {
-    return &g_syncOpEOF;
+  if (dir->pack) {
+    if (dir->packNext == dir->packEnd) return &g_syncOpEOF;
+    packDirEntry(dir->pack->index, dir->pack->index.entries[dir->packNext++], out);
+    return &g_syncOp;
   }
-
-  *out = dir->currentEntry;
-  WIN32_FIND_DATAW found;
-  if (FindNextFileW(dir->fileHandle, &found)) {
-    hutf8::uc2_to_utf8((uint16_t*)found.cFileName, dir->currentEntry.filename,
-                       HART_ARRAYSIZE(dir->currentEntry.filename));
-    dir->currentEntry.typeFlags = 0;
-    if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-      dir->currentEntry.typeFlags |= (uint32_t)FileEntryType::Dir;
-    } else {
-      dir->currentEntry.typeFlags |= (uint32_t)FileEntryType::File;
-    }
-    if (found.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
-      dir->currentEntry.typeFlags |= (uint32_t)FileEntryType::SymLink;
-    }
-  } else {
-    CloseHandle(dir->fileHandle);
-    dir->fileHandle = INVALID_HANDLE_VALUE;
+  if (dir->next == dir->listed.size()) {
+    return &g_syncOpEOF;
   }
 
+  hDir::Listed const& found = dir->listed[dir->next++];
+  hcrt::strncpy(out->filename, HART_ARRAYSIZE(out->filename), dir->names.c_str() + found.name);
+  out->typeFlags = found.typeFlags;
   return &g_syncOp;
 }
 
 void closeDir(FileHandle dir) {
-  delete dir;
+  delete static_cast<hDir*>(dir);
 }
 
-FileOpHandle freadAsync(FileHandle file, void* buffer, size_t size, uint64_t offset) {
+static FileOpHandle issueRW(HANDLE handle, Mode mode, void* buffer, size_t size, uint64_t offset) {
   auto* new_op = new FileOpRW();
-  new_op->fileHdl = file->fileHandle;
+  new_op->fileHdl = handle;
   new_op->operation.Offset = offset & 0xFFFFFFFF;
   new_op->operation.OffsetHigh = (offset & ((uint64_t)0xFFFFFFFF << 32)) >> 32;
-  auto Completed = ReadFile(file->fileHandle, buffer, (DWORD)size, nullptr, &new_op->operation);
+  auto Completed = mode == Mode::Read ? ReadFile(handle, buffer, (DWORD)size, nullptr, &new_op->operation)
+                                      : WriteFile(handle, buffer, (DWORD)size, nullptr, &new_op->operation);
   if (Completed) {
     delete new_op;
     return &g_syncOp;
@@ -257,17 +683,61 @@ FileOpHandle freadAsync(FileHandle file, void* buffer, size_t size, uint64_t off
   return new_op;
 }
 
-FileOpHandle fwriteAsync(FileHandle file, const void* buffer, size_t size, uint64_t offset) {
-  auto* new_op = new FileOpRW();
-  new_op->fileHdl = file->fileHandle;
-  new_op->operation.Offset = offset & 0xFFFFFFFF;
-  new_op->operation.OffsetHigh = (offset & ((uint64_t)0xFFFFFFFF << 32)) >> 32;
-  auto Completed = WriteFile(file->fileHandle, buffer, (DWORD)size, nullptr, &new_op->operation);
-  if (Completed) {
-    delete new_op;
-    return &g_syncOp;
+// Only the aligned part of an aligned buffer at an aligned offset can skip the cache, the rest is issued alongside it
+static FileOpHandle issueFileRW(FileHandle file, Mode mode, void* buffer, size_t size, uint64_t offset) {
+  size_t mask = directAlignment() - 1;
+  size_t direct = size & ~mask;
+  if (file->directHandle == INVALID_HANDLE_VALUE || (offset & mask) != 0 || ((uintptr_t)buffer & mask) != 0 ||
+      direct == 0) {
+    return issueRW(file->fileHandle, mode, buffer, size, offset);
   }
-  return new_op;
+  if (direct == size) return issueRW(file->directHandle, mode, buffer, size, offset);
+
+  auto* batch = new FileOpBatch();
+  batch->split = true;
+  FileOpHandle parts[] = {
+    issueRW(file->directHandle, mode, buffer, direct, offset),
+    issueRW(file->fileHandle, mode, (uint8_t*)buffer + direct, size - direct, offset + direct),
+  };
+  for (FileOpHandle op : parts) {
+    if (op == &g_syncOp || op == &g_syncOpEOF) {
+      mergeBatchResult(batch, op == &g_syncOp ? Error::Ok : Error::EndOfFile);
+      continue;
+    }
+    batch->reads.push_back(op);
+  }
+  return batch;
+}
+
+FileOpHandle freadAsync(FileHandle file, void* buffer, size_t size, uint64_t offset) {
+  if (file->pack && !toArchiveRead(file, &offset, &size)) return &g_syncOpEOF;
+  return issueFileRW(file, Mode::Read, buffer, size, offset);
+}
+
+// Through the cache, as the ranges of a batch are rarely aligned
+FileOpHandle freadAsyncBatch(ReadRequest const* reads, uint32_t count) {
+  if (count == 0) return &g_syncOp;
+  auto* batch = new FileOpBatch();
+  batch->reads.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t offset = reads[i].offset;
+    size_t   size = reads[i].size;
+    if (reads[i].file->pack && !toArchiveRead(reads[i].file, &offset, &size)) {
+      mergeBatchResult(batch, Error::EndOfFile);
+      continue;
+    }
+    FileOpHandle op = issueRW(reads[i].file->fileHandle, Mode::Read, reads[i].buffer, size, offset);
+    if (op == &g_syncOp || op == &g_syncOpEOF) {
+      mergeBatchResult(batch, op == &g_syncOp ? Error::Ok : Error::EndOfFile);
+      continue;
+    }
+    batch->reads.push_back(op);
+  }
+  return batch;
+}
+
+FileOpHandle fwriteAsync(FileHandle file, const void* buffer, size_t size, uint64_t offset) {
+  return issueFileRW(file, Mode::Write, (void*)buffer, size, offset);
 }
 
 static time_t FILETIMETotime_t(FILETIME const& ft) {
@@ -278,11 +748,249 @@ static time_t FILETIMETotime_t(FILETIME const& ft) {
 }
 
 FileOpHandle fstatAsync(FileHandle filename, FileStat* out) {
-  BY_HANDLE_FILE_INFORMATION fileinfo;
-  GetFileInformationByHandle(filename->fileHandle, &fileinfo);
-  out->filesize = ((uint64_t)fileinfo.nFileSizeHigh << 32) | fileinfo.nFileSizeLow;
-  out->modifiedDate = FILETIMETotime_t(fileinfo.ftLastWriteTime);
-  return &g_syncOp;
+  // Answered from the pack's index
+  if (filename->pack) {
+    out->filesize = filename->packEntry->size;
+    out->modifiedDate = (time_t)filename->packEntry->mtime;
+    return &g_syncOp;
+  }
+  HANDLE fhandle = filename->fileHandle;
+  return queueMetaOp([fhandle, out]() {
+    BY_HANDLE_FILE_INFORMATION fileinfo;
+    if (!GetFileInformationByHandle(fhandle, &fileinfo)) return Error::Failed;
+    out->filesize = ((uint64_t)fileinfo.nFileSizeHigh << 32) | fileinfo.nFileSizeLow;
+    out->modifiedDate = FILETIMETotime_t(fileinfo.ftLastWriteTime);
+    return Error::Ok;
+  });
+}
+
+struct MappedFile {
+  HANDLE      fileHandle; // INVALID_HANDLE_VALUE when it's a pack's
+  HANDLE      mapping;
+  void const* base; // the view rounded down to the allocation granularity
+};
+
+// Windows has no read ahead policy per view, Sequential and Random are given to the cache manager when the file is
+// opened. Prefetching pages in is the only hint that can be given later.
+static void prefetchMappedRange(void const* data, uint64_t size) {
+  WIN32_MEMORY_RANGE_ENTRY entry = {(PVOID)data, (SIZE_T)size};
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+}
+
+bool mapFile(const char* filename, MappedView* out) {
+  return mapFile(filename, MapRange(), out);
+}
+
+// range is within the file_size bytes of fhandle from file_offset, all of it unless the file is in a pack. The caller
+// keeps fhandle.
+static bool mapRange(HANDLE fhandle, uint64_t file_offset, uint64_t file_size, MapRange const& range, MappedView* out) {
+  // Can't map an empty range
+  if (range.offset >= file_size) return false;
+  uint64_t size = file_size - range.offset;
+  if (range.size && range.size < size) size = range.size;
+  uint64_t offset = file_offset + range.offset;
+  HANDLE   mapping = CreateFileMappingW(fhandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) return false;
+  // View offsets must be a multiple of the allocation granularity
+  SYSTEM_INFO sys_info;
+  GetSystemInfo(&sys_info);
+  uint64_t    start = offset - offset % sys_info.dwAllocationGranularity;
+  void const* base =
+    MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start, (SIZE_T)(size + offset - start));
+  if (!base) {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  MappedFile* mf = new MappedFile();
+  mf->fileHandle = INVALID_HANDLE_VALUE;
+  mf->mapping = mapping;
+  mf->base = base;
+  out->data = (uint8_t const*)base + (offset - start);
+  out->size = size;
+  out->platform = mf;
+  if (range.hint == MapHint::WillNeed || range.prefault) prefetchMappedRange(out->data, size);
+  if (range.prefault) {
+    // Prefetching is only a hint, touching each page makes sure it's in
+    for (uint64_t i = 0; i < size; i += sys_info.dwPageSize)
+      (void)*(volatile uint8_t const*)((uint8_t const*)out->data + i);
+  }
+  return true;
+}
+
+// A pack's files are mapped from its handle, so the Sequential and Random hints are lost on them
+bool mapFile(const char* filename, MapRange const& range, MappedView* out) {
+  PackEntry const* entry;
+  if (PackArchive* pack = findPackEntry(filename, &entry)) {
+    return entry && !(entry->flags & PackEntry_Dir) &&
+           mapRange(pack->fileHandle, entry->offset, entry->size, range, out);
+  }
+
+  wchar_t filename_wide[HART_MAX_PATH];
+  getExpanedPathUC2(filename, filename_wide);
+  DWORD flags = FILE_ATTRIBUTE_NORMAL;
+  if (range.hint == MapHint::Sequential) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+  if (range.hint == MapHint::Random) flags |= FILE_FLAG_RANDOM_ACCESS;
+  HANDLE fhandle = CreateFileW(filename_wide, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                               flags, nullptr);
+  if (fhandle == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER filesize;
+  if (GetFileSizeEx(fhandle, &filesize) == FALSE || !mapRange(fhandle, 0, (uint64_t)filesize.QuadPart, range, out)) {
+    CloseHandle(fhandle);
+    return false;
+  }
+  ((MappedFile*)out->platform)->fileHandle = fhandle;
+  return true;
+}
+
+void unmapFile(MappedView* view) {
+  MappedFile* mf = (MappedFile*)view->platform;
+  if (!mf) return;
+  UnmapViewOfFile(mf->base);
+  CloseHandle(mf->mapping);
+  if (mf->fileHandle != INVALID_HANDLE_VALUE) CloseHandle(mf->fileHandle);
+  delete mf;
+  *view = MappedView();
+}
+
+void adviseMappedView(MappedView const* view, uint64_t offset, uint64_t size, MapHint hint) {
+  if (!view->platform || offset >= view->size || hint != MapHint::WillNeed) return;
+  if (!size || size > view->size - offset) size = view->size - offset;
+  prefetchMappedRange((uint8_t const*)view->data + offset, size);
+}
+
+// In the session's namespace, shared by the processes of one login
+static void sharedMemoryName(const char* name, wchar_t (&out)[HART_MAX_PATH]) {
+  char local_name[HART_MAX_PATH];
+  hcrt::sprintf(local_name, sizeof(local_name), "Local\\%s", name);
+  hutf8::utf8_to_uc2(local_name, (uint16_t*)out, HART_MAX_PATH);
+}
+
+static bool mapSharedMemory(HANDLE mapping, DWORD access, SharedMemory* out) {
+  void* data = MapViewOfFile(mapping, access, 0, 0, 0);
+  MEMORY_BASIC_INFORMATION info;
+  if (!data || VirtualQuery(data, &info, sizeof(info)) == 0) {
+    if (data) UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    return false;
+  }
+  out->data = data;
+  out->size = info.RegionSize;
+  out->platform = mapping;
+  return true;
+}
+
+bool createSharedMemory(const char* name, uint64_t size, SharedMemory* out) {
+  wchar_t name_wide[HART_MAX_PATH];
+  sharedMemoryName(name, name_wide);
+  // Backed by the page file
+  HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32),
+                                      (DWORD)size, name_wide);
+  if (!mapping) return false;
+  if (GetLastError() == ERROR_ALREADY_EXISTS) {
+    CloseHandle(mapping);
+    return false;
+  }
+  return mapSharedMemory(mapping, FILE_MAP_WRITE, out);
+}
+
+bool openSharedMemory(const char* name, SharedMemory* out) {
+  wchar_t name_wide[HART_MAX_PATH];
+  sharedMemoryName(name, name_wide);
+  // Names are in the Local namespace, so this opens memory from any process in the session
+  HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name_wide);
+  if (!mapping) return false;
+  return mapSharedMemory(mapping, FILE_MAP_READ, out);
+}
+
+void closeSharedMemory(SharedMemory* shm) {
+  if (!shm->platform) return;
+  UnmapViewOfFile(shm->data);
+  CloseHandle((HANDLE)shm->platform);
+  *shm = SharedMemory();
+}
+
+// The memory goes with the last view of it
+void removeSharedMemory(const char*) {}
+
+static bool issueWatchRead(Watch* watch) {
+  DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE;
+  return ReadDirectoryChangesW(watch->dirHandle, watch->buffer, sizeof(watch->buffer), TRUE, filter, nullptr,
+                               &watch->operation, nullptr) != FALSE;
+}
+
+WatchHandle watchDirectory(const char* path) {
+  // Packs never change
+  PackEntry const* entry;
+  if (findPackEntry(path, &entry)) return nullptr;
+
+  wchar_t path_wide[HART_MAX_PATH];
+  getExpanedPathUC2(path, path_wide);
+  HANDLE dhandle = CreateFileW(path_wide, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+  if (dhandle == INVALID_HANDLE_VALUE) return nullptr;
+
+  auto* watch = new Watch();
+  watch->dirHandle = dhandle;
+  hcrt::zeromem(&watch->operation, sizeof(OVERLAPPED));
+  watch->operation.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+  if (!issueWatchRead(watch)) {
+    closeWatch(watch);
+    return nullptr;
+  }
+  return watch;
+}
+
+static void readWatchEvents(Watch* watch) {
+  DWORD xferred;
+  if (GetOverlappedResult(watch->dirHandle, &watch->operation, &xferred, FALSE) == FALSE) return;
+
+  // A zero sized result means the buffer overflowed and the changes were lost
+  for (uint8_t const* ptr = (uint8_t const*)watch->buffer; xferred;) {
+    auto const* info = (FILE_NOTIFY_INFORMATION const*)ptr;
+    if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED ||
+        info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+      wchar_t name_wide[HART_MAX_PATH];
+      size_t  len = hutil::tmin<size_t>(info->FileNameLength / sizeof(wchar_t), HART_MAX_PATH - 1);
+      hcrt::memcpy(name_wide, info->FileName, len * sizeof(wchar_t));
+      name_wide[len] = 0;
+      char name[HART_MAX_PATH];
+      hutf8::uc2_to_utf8((uint16_t*)name_wide, name, HART_MAX_PATH);
+      for (char* c = name; *c; ++c) {
+        if (*c == '\\') *c = '/';
+      }
+      // Directories are reported too, they just won't match any file the caller is interested in
+      watch->changed.push_back(name);
+    }
+    if (!info->NextEntryOffset) break;
+    ptr += info->NextEntryOffset;
+  }
+  ResetEvent(watch->operation.hEvent);
+  issueWatchRead(watch);
+}
+
+bool readWatch(WatchHandle watch, DirEntry* out) {
+  if (watch->nextChanged == watch->changed.size()) {
+    watch->changed.clear();
+    watch->nextChanged = 0;
+    readWatchEvents(watch);
+    if (watch->changed.empty()) return false;
+  }
+
+  hcrt::strcpy(out->filename, HART_ARRAYSIZE(out->filename), watch->changed[watch->nextChanged++].c_str());
+  out->typeFlags = (uint32_t)FileEntryType::File;
+  return true;
+}
+
+void closeWatch(WatchHandle watch) {
+  if (!watch) return;
+  // The pending read writes into watch->buffer, so wait for the cancel to land before freeing it
+  DWORD xferred;
+  if (CancelIo(watch->dirHandle)) GetOverlappedResult(watch->dirHandle, &watch->operation, &xferred, TRUE);
+  CloseHandle(watch->dirHandle);
+  CloseHandle(watch->operation.hEvent);
+  delete watch;
 }
 
 bool isAbsolutePath(const char* path) {
@@ -298,18 +1006,65 @@ void mountPoint(const char* path, const char* mount) {
   char expath[HART_MAX_PATH];
   getExpanedPath(path, expath, HART_MAX_PATH);
   hdbassert(isAbsPath(expath), "Expanded path is not absolute");
+  MountTable const*  table = hatomic::atomicGet(g_mountTable);
+  std::vector<Mount> mounts;
+  if (table) mounts = table->mounts;
   Mount mnt;
   mnt.mountName = mount;
   mnt.mountPoint = expath;
-  g_mounts.push_back(mnt);
-  std::stable_sort(g_mounts.begin(), g_mounts.end(),
-                   [](const Mount& lhs, const Mount& rhs) { return lhs.mountName.size() > rhs.mountName.size(); });
+  mounts.push_back(mnt);
+  publishMountTable(std::move(mounts));
 }
 
 void unmountPoint(const char* mount) {
+  hScopedMutex       sentry(&g_mountMtx);
+  MountTable const*  table = hatomic::atomicGet(g_mountTable);
+  std::vector<Mount> mounts;
+  if (table) mounts = table->mounts;
+  mounts.erase(std::remove_if(mounts.begin(), mounts.end(),
+                              [=](const Mount& rhs) { return hcrt::strcmp(mount, rhs.mountName.c_str()) == 0; }),
+               mounts.end());
+  publishMountTable(std::move(mounts));
+}
+
+bool mountPack(const char* pack_path, const char* mount) {
   hScopedMutex sentry(&g_mountMtx);
-  std::remove_if(g_mounts.begin(), g_mounts.end(),
-                 [=](const Mount& rhs) { return hcrt::strcmp(mount, rhs.mountName.c_str()) == 0; });
+  hdbassert(isAbsolutePath(mount), "Path is not absolute");
+  PackEntry const* entry;
+  if (findPackEntry(pack_path, &entry)) return false;
+  char expath[HART_MAX_PATH];
+  getExpanedPath(pack_path, expath, HART_MAX_PATH);
+  wchar_t path_wide[HART_MAX_PATH];
+  hutf8::utf8_to_uc2(expath, (uint16_t*)path_wide, HART_MAX_PATH);
+  std::unique_ptr<PackArchive> pack(new PackArchive());
+  pack->fileHandle = CreateFileW(path_wide, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+  LARGE_INTEGER filesize;
+  PackHeader    header;
+  // Reads stop short at the end of the file without failing, so check it's big enough first
+  if (pack->fileHandle == INVALID_HANDLE_VALUE || GetFileSizeEx(pack->fileHandle, &filesize) == FALSE ||
+      (uint64_t)filesize.QuadPart < sizeof(header) ||
+      fileOpWait(issueRW(pack->fileHandle, Mode::Read, &header, sizeof(header), 0)) != Error::Ok ||
+      PackIndex::indexSize(header) > (uint64_t)filesize.QuadPart) {
+    return false;
+  }
+  std::vector<uint8_t> index((size_t)PackIndex::indexSize(header));
+  if (fileOpWait(issueRW(pack->fileHandle, Mode::Read, index.data(), index.size(), 0)) != Error::Ok ||
+      !pack->index.load(index.data(), (uint64_t)filesize.QuadPart)) {
+    return false;
+  }
+
+  MountTable const*  table = hatomic::atomicGet(g_mountTable);
+  std::vector<Mount> mounts;
+  if (table) mounts = table->mounts;
+  Mount mnt;
+  mnt.mountName = mount;
+  mnt.mountPoint = expath;
+  mnt.pack = pack.get();
+  mounts.push_back(mnt);
+  g_packArchives.push_back(std::move(pack));
+  publishMountTable(std::move(mounts));
+  return true;
 }
 
 void getCurrentWorkingDir(char* out, uint32_t bufsize) {